@@ -0,0 +1,47 @@
+#pragma once
+
+#include "common_header.hpp"
+#include <new>
+#include <cstddef>
+#include <utility>
+#include <type_traits>
+
+// 一块按 cache line 对齐的连续内存，只用于 trivially copyable 的元素
+template <typename T>
+requires std::is_trivially_copyable_v<T>
+class AlignedBuffer {
+    static constexpr size_t ALIGNMENT = 64;
+    T* ptr = nullptr;
+    size_t n = 0;
+
+public:
+    AlignedBuffer() = default;
+    AlignedBuffer(const AlignedBuffer&) = delete;
+    AlignedBuffer& operator=(const AlignedBuffer&) = delete;
+    AlignedBuffer(AlignedBuffer&& other): ptr(other.ptr), n(other.n) {
+        other.ptr = nullptr;
+        other.n = 0;
+    }
+    AlignedBuffer& operator=(AlignedBuffer&& other) {
+        std::swap(ptr, other.ptr);
+        std::swap(n, other.n);
+        return *this;
+    }
+    ~AlignedBuffer() {
+        if(ptr) ::operator delete(ptr, std::align_val_t{ALIGNMENT});
+    }
+
+    // 大小不变时保留原有内存
+    void resize(size_t size) {
+        if(size == n) return;
+        if(ptr) ::operator delete(ptr, std::align_val_t{ALIGNMENT});
+        ptr = size ? (T*) ::operator new(size * sizeof(T), std::align_val_t{ALIGNMENT}) : nullptr;
+        n = size;
+    }
+
+    size_t size() const { return n; }
+    T* data() { return ptr; }
+    const T* data() const { return ptr; }
+    T& operator[](size_t i) { return ptr[i]; }
+    const T& operator[](size_t i) const { return ptr[i]; }
+};
@@ -3,17 +3,25 @@
 #include "common_header.hpp"
 
 #include "shader.hpp"
+#include "texture.hpp"
+#include "shading_kernels.hpp"
 #include "OBJ_Loader.h"
 #include <iostream>
+#include <bit>
+
+// 一个物体（材质）共用一份，不参与插值
+struct BlinnPhongMaterial {
+    objl::Material material;
+    std::shared_ptr<const Texture> map_Kd = nullptr;
+    std::shared_ptr<const Texture> map_Ka = nullptr;
+    std::shared_ptr<const Texture> map_Ks = nullptr;
+    std::shared_ptr<const Texture> map_bump = nullptr;
+};
 
 struct BlinnPhongAttribute {
     objl::Vertex vertex;
-    objl::Material material;
     Mat3 TBN;
-    std::shared_ptr<const Image> map_Kd = nullptr;
-    std::shared_ptr<const Image> map_Ka = nullptr;
-    std::shared_ptr<const Image> map_Ks = nullptr;
-    std::shared_ptr<const Image> map_bump = nullptr;
+    std::shared_ptr<const BlinnPhongMaterial> material = nullptr;
 };
 
 struct Light {
@@ -26,45 +34,30 @@ public:
     std::vector<Light> lights;
 };
 
+// 只有 normal_world_n 和 uv 插值（见下面的 VaryingLayout）。其余是每个三角形（或每个物体）的常量，
+// 取三角形第一个顶点（provoking vertex）的值。
 class BlinnPhongProperty: public AbstractInterpolatable {
 public:
     BlinnPhongProperty() = default;
     BlinnPhongProperty(const Vec3& normal, 
                        const Vec2& uv, 
-                       const Mat3& TBN,
-                       const objl::Material& material,
-                       const Mat4& M,
+                       const Mat3& TBN_world,
                        const Vec3& camera_pos,
-                       std::shared_ptr<const Image> map_Kd,
-                       std::shared_ptr<const Image> map_Ka,
-                       std::shared_ptr<const Image> map_Ks,
-                       std::shared_ptr<const Image> map_bump):
-                    normal_world_n(normal), uv(uv), map_Kd(map_Kd), 
-                    map_Ka(map_Ka), map_Ks(map_Ks), material(material), 
-                    M(M), camera_pos(camera_pos), map_bump(map_bump), TBN(TBN) {}
+                       const BlinnPhongMaterial* material):
+                    normal_world_n(normal), uv(uv), TBN_world(TBN_world), camera_pos(camera_pos), material(material) {}
 
     Vec3 normal_world_n;
     Vec2 uv;
-    Mat3 TBN;
-    std::shared_ptr<const Image> map_Kd = nullptr;
-    std::shared_ptr<const Image> map_Ka = nullptr;
-    std::shared_ptr<const Image> map_Ks = nullptr;
-    std::shared_ptr<const Image> map_bump = nullptr;
-    Mat4 M;
+
+    Mat3 TBN_world;     // 切线空间到世界空间：M 左上角的 3x3 乘 TBN
     Vec3 camera_pos;
-    
-    objl::Material material;
-    // TODO 这其实很不合理。。。要求插值顺序了。。
-    // TODO: assert map_Kd is the same
-    BlinnPhongProperty operator+(const BlinnPhongProperty& other) const {
-        return BlinnPhongProperty{ normal_world_n + other.normal_world_n, uv + other.uv, TBN, material, M, camera_pos, map_Kd, map_Ka, map_Ks, map_bump };
-    }
-    
-    BlinnPhongProperty operator*(float k) const {
-        return BlinnPhongProperty{ normal_world_n * k, uv * k, TBN, material, M, camera_pos, map_Kd, map_Ka, map_Ks, map_bump };
-    }
+    // 材质由物体的所有 attribute 通过 shared_ptr 共享，物体存在期间一直有效
+    const BlinnPhongMaterial* material = nullptr;
 };
 
+template <>
+struct VaryingLayout<BlinnPhongProperty>: Varyings<&BlinnPhongProperty::normal_world_n, &BlinnPhongProperty::uv> {};
+
 
 class BlinnPhongVShader: public VShader<BlinnPhongAttribute, BlinnPhongProperty, BlinnPhongUniform> {
 public:
@@ -80,19 +73,20 @@ public:
         // vert
         vert.pos_model = { data.Position.X, data.Position.Y, data.Position.Z };
         vert.properties.normal_world_n = to_vec3_as_dir(info.M * to_vec4_as_dir({ data.Normal.X, data.Normal.Y, data.Normal.Z })).normalized();
-        vert.properties.TBN = attr.TBN;
-
-        // material
-        vert.properties.map_Kd = attr.map_Kd;
-        vert.properties.map_Ka = attr.map_Ka;
-        vert.properties.map_Ks = attr.map_Ks;
-        vert.properties.map_bump = attr.map_bump;
         vert.properties.uv = { attr.vertex.TextureCoordinate.X, attr.vertex.TextureCoordinate.Y };
-        vert.properties.material = attr.material;
 
-        // rasterizer
-        vert.properties.M = info.M;
+        // 不插值的部分按值保存，attr 和 info 可能是临时对象
+        for(int i = 0; i < 3; i++) {
+            for(int j = 0; j < 3; j++) {
+                float sum = 0;
+                for(int k = 0; k < 3; k++) {
+                    sum += info.M[{i, k}] * attr.TBN[{k, j}];
+                }
+                vert.properties.TBN_world[{i, j}] = sum;
+            }
+        }
         vert.properties.camera_pos = info.camera_pos;
+        vert.properties.material = attr.material.get();
 
         return vert;
     }
@@ -102,17 +96,12 @@ RGBAColor objl_vec3_to_color(const objl::Vector3& vec3) {
     return RGBAColor{ vec3.X, vec3.Y, vec3.Z, 1.0 };
 }
 
-RGBAColor get_texture(std::shared_ptr<const Image> texture, const Vec2& uv) {
+// 没有导数时（逐像素的 shade）lod 为 0，只读原图
+RGBAColor get_texture(const std::shared_ptr<const Texture>& texture, const Vec2& uv, float lod = 0) {
     if(!texture) {
         return RGBAColor{1.0, 1.0, 1.0, 1.0};
     }
-
-    auto [width, height] = texture->size();
-    auto texture_color = texture->getPixel(
-        std::max<int>(0, std::min<int>(width - 1, lround(uv[0] * (width - 1)))), 
-        std::max<int>(0, std::min<int>(height - 1, lround(uv[1] * (height - 1))))
-    );
-    return texture_color;
+    return texture->sample(uv, lod);
 }
 
 class BlinnPhongFShader: public FShader<BlinnPhongProperty, BlinnPhongUniform> {
@@ -123,31 +112,31 @@ public:
     ) const {
         
         RGBAColor out = {0, 0, 0, 1};
+        auto& material = *fragment.properties.material;
         auto normal_world = fragment.properties.normal_world_n.normalized();
 
         // bump mapping (normal)
         // 改变的：表面法向量
-        if(fragment.properties.map_bump != nullptr) {
+        if(material.map_bump != nullptr) {
             
             // change normal_world
-            auto normal_c = get_texture(fragment.properties.map_bump, fragment.properties.uv);
+            auto normal_c = get_texture(material.map_bump, fragment.properties.uv);
             Vec3 normal_tangent {
                 normal_c.r * 2 - 1,
                 normal_c.g * 2 - 1,
                 normal_c.b * 2 - 1
             };
-            Vec3 normal_model = fragment.properties.TBN * normal_tangent;
-            normal_world = to_vec3_as_dir(fragment.properties.M * to_vec4_as_dir(normal_model)).normalized();
+            normal_world = (fragment.properties.TBN_world * normal_tangent).normalized();
         } 
         
         // what if no map ?
         {
-            for(auto light: uniform.lights) {
+            for(const auto& light: uniform.lights) {
                 auto light_pos_world = light.pos;
                 
                 //// kd
                 // texture
-                auto texture_color = get_texture(fragment.properties.map_Kd, fragment.properties.uv);
+                auto texture_color = get_texture(material.map_Kd, fragment.properties.uv);
             
                 // coefficient
                 auto k = std::max<float>(0, dot_product(
@@ -157,26 +146,26 @@ public:
                 auto r_squared = (light.pos - fragment.pos_world).norm2_squared();
                 auto eff = k / r_squared;
 
-                auto c = objl_vec3_to_color(fragment.properties.material.Kd) * texture_color * light.intensity * eff;
+                auto c = objl_vec3_to_color(material.material.Kd) * texture_color * light.intensity * eff;
                 out += c;
 
                 //// ks
                 // texture
-                auto highlight_texture_color = get_texture(fragment.properties.map_Ks, fragment.properties.uv);
+                auto highlight_texture_color = get_texture(material.map_Ks, fragment.properties.uv);
                 
                 auto h = ((fragment.properties.camera_pos - fragment.pos_world).normalized() + (light_pos_world - fragment.pos_world).normalized()).normalized();
-                auto s = objl_vec3_to_color(fragment.properties.material.Ks) * 
+                auto s = objl_vec3_to_color(material.material.Ks) * 
                        highlight_texture_color * 
-                       pow( (float)std::max<float>(0, dot_product(normal_world, h)), (float) fragment.properties.material.Ns);
+                       pow( (float)std::max<float>(0, dot_product(normal_world, h)), (float) material.material.Ns);
                 out += s;
             }
         }
 
         {
             // Ka
-            auto texture_color = get_texture(fragment.properties.map_Ka, fragment.properties.uv);
+            auto texture_color = get_texture(material.map_Ka, fragment.properties.uv);
 
-            auto a = objl_vec3_to_color(fragment.properties.material.Ka) * texture_color;
+            auto a = objl_vec3_to_color(material.material.Ka) * texture_color;
             out += a;
         }
        
@@ -184,4 +173,92 @@ public:
 
         return out.clip();
     }
+
+    // 与逐个调用 shade 的算法相同（但纹理按 uv 的导数选 mip 层级）。纹理采样和 bump mapping 逐个 lane，
+    // 法向量、视线的归一化和光照在所有 lane 上用 SIMD 一起做（见 shading_kernels.hpp），mask 只在写回时生效。
+    // 一个 packet 里的像素属于同一物体，材质相同；TBN 按三角形不同。
+    void shade_batch(
+        const FragmentPacket<BlinnPhongProperty>& packet,
+        const BlinnPhongUniform& uniform,
+        RGBAColor* out
+    ) const {
+        constexpr int LANES = FragmentPacket<BlinnPhongProperty>::LANES;
+        static_assert(LANES == SHADING_LANES);
+        auto active = [&](int i) { return (packet.mask & (1u << i)) != 0; };
+
+        auto& first = *packet.flat[std::countr_zero(packet.mask)];
+        auto& material = *first.material;
+        const float* u = packet.varying<&BlinnPhongProperty::uv>(0);
+        const float* v = packet.varying<&BlinnPhongProperty::uv>(1);
+        const float* dudx = packet.varying_ddx<&BlinnPhongProperty::uv>(0);
+        const float* dvdx = packet.varying_ddx<&BlinnPhongProperty::uv>(1);
+        const float* dudy = packet.varying_ddy<&BlinnPhongProperty::uv>(0);
+        const float* dvdy = packet.varying_ddy<&BlinnPhongProperty::uv>(1);
+
+        // mip 层级按各个纹理自己的尺寸算
+        auto sample = [&](const std::shared_ptr<const Texture>& texture, int i) {
+            if(!texture) return get_texture(texture, Vec2{ u[i], v[i] });
+            return texture->sample(Vec2{ u[i], v[i] }, texture->lod(dudx[i], dvdx[i], dudy[i], dvdy[i]));
+        };
+
+        BlinnPhongLanes lanes {};
+        lanes.Ns = material.material.Ns;
+        for(int c = 0; c < 3; c++) {
+            for(int i = 0; i < LANES; i++) {
+                lanes.pos[c][i] = packet.pos_world[c][i];
+                lanes.n[c][i] = packet.varying<&BlinnPhongProperty::normal_world_n>(c)[i];
+                lanes.view[c][i] = first.camera_pos[c] - packet.pos_world[c][i];
+            }
+        }
+        normalize_lanes(lanes.n);
+        normalize_lanes(lanes.view);
+
+        // bump mapping：覆盖归一化过的插值法向量
+        if(material.map_bump != nullptr) {
+            for(int i = 0; i < LANES; i++) {
+                if(!active(i)) continue;
+                auto normal_c = sample(material.map_bump, i);
+                Vec3 normal_tangent {
+                    normal_c.r * 2 - 1,
+                    normal_c.g * 2 - 1,
+                    normal_c.b * 2 - 1
+                };
+                Vec3 normal_world = (packet.flat[i]->TBN_world * normal_tangent).normalized();
+                for(int c = 0; c < 3; c++) {
+                    lanes.n[c][i] = normal_world[c];
+                }
+            }
+        }
+
+        // 纹理颜色乘上材质系数，和光源无关
+        const float Kd[3] = { material.material.Kd.X, material.material.Kd.Y, material.material.Kd.Z };
+        const float Ks[3] = { material.material.Ks.X, material.material.Ks.Y, material.material.Ks.Z };
+        const float Ka[3] = { material.material.Ka.X, material.material.Ka.Y, material.material.Ka.Z };
+        float ka[3][LANES] = {};
+        for(int i = 0; i < LANES; i++) {
+            if(!active(i)) continue;
+            RGBAColor cd = sample(material.map_Kd, i);
+            RGBAColor cs = sample(material.map_Ks, i);
+            RGBAColor ca = sample(material.map_Ka, i);
+            const float td[3] = { cd.r, cd.g, cd.b }, ts[3] = { cs.r, cs.g, cs.b }, ta[3] = { ca.r, ca.g, ca.b };
+            for(int c = 0; c < 3; c++) {
+                lanes.kd[c][i] = Kd[c] * td[c];
+                lanes.ks[c][i] = Ks[c] * ts[c];
+                ka[c][i] = Ka[c] * ta[c];
+            }
+        }
+
+        float color[3][LANES] = {};
+        for(const auto& light: uniform.lights) {
+            const float light_pos[3] = { light.pos[0], light.pos[1], light.pos[2] };
+            const float intensity[3] = { light.intensity.r, light.intensity.g, light.intensity.b };
+            blinn_phong_light(lanes, light_pos, intensity, color);
+        }
+
+        for(int i = 0; i < LANES; i++) {
+            if(!active(i)) continue;
+            RGBAColor c { color[0][i] + ka[0][i], color[1][i] + ka[1][i], color[2][i] + ka[2][i], 1 };
+            out[i] = c.clip();
+        }
+    }
 };
\ No newline at end of file
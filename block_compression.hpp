@@ -0,0 +1,173 @@
+#pragma once
+
+#include "common_header.hpp"
+#include <cstdint>
+#include <algorithm>
+#include <utility>
+#include <cstdlib>
+
+// BC1 / BC3 的 4x4 块编解码。texel 是 RGBA8（r 在最低字节），块内 16 个 texel 按行排列。
+// 块按 uint32_t 存放：BC1 两个字（两个 565 端点、16 个 2 位下标），BC3 四个字（alpha 块在前，颜色块在后）。
+// 编码器只用包围盒对角线作端点，质量一般但足够快，适合离线的压缩工具。
+
+constexpr int BC1_BLOCK_WORDS = 2;
+constexpr int BC3_BLOCK_WORDS = 4;
+
+inline uint32_t bc_channel(uint32_t texel, int c) {
+    return (texel >> (8 * c)) & 0xff;
+}
+
+inline uint16_t bc_pack_565(const int rgb[3]) {
+    int r = (rgb[0] * 31 + 127) / 255;
+    int g = (rgb[1] * 63 + 127) / 255;
+    int b = (rgb[2] * 31 + 127) / 255;
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+inline void bc_unpack_565(uint16_t c, int rgb[3]) {
+    int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+    rgb[0] = (r << 3) | (r >> 2);
+    rgb[1] = (g << 2) | (g >> 4);
+    rgb[2] = (b << 3) | (b >> 2);
+}
+
+// four_colors 时四色，否则三色，palette[3] 是透明黑。palette[i] 是 RGBA
+inline void bc_color_palette(uint16_t c0, uint16_t c1, bool four_colors, int palette[4][4]) {
+    bc_unpack_565(c0, palette[0]);
+    bc_unpack_565(c1, palette[1]);
+    palette[0][3] = palette[1][3] = 255;
+    for(int c = 0; c < 3; c++) {
+        if(four_colors) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        } else {
+            palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+            palette[3][c] = 0;
+        }
+    }
+    palette[2][3] = 255;
+    palette[3][3] = four_colors ? 255 : 0;
+}
+
+// 总是编成四色块
+inline void bc_encode_color(const uint32_t texels[16], uint32_t out[2]) {
+    int lo[3] = { 255, 255, 255 }, hi[3] = { 0, 0, 0 };
+    for(int i = 0; i < 16; i++) {
+        for(int c = 0; c < 3; c++) {
+            int v = (int)bc_channel(texels[i], c);
+            lo[c] = std::min(lo[c], v);
+            hi[c] = std::max(hi[c], v);
+        }
+    }
+
+    uint16_t c0 = bc_pack_565(hi), c1 = bc_pack_565(lo);
+    if(c0 < c1) std::swap(c0, c1);
+    if(c0 == c1) {
+        out[0] = c0 | ((uint32_t)c1 << 16);
+        out[1] = 0;
+        return;
+    }
+
+    int palette[4][4];
+    bc_color_palette(c0, c1, true, palette);
+
+    uint32_t indices = 0;
+    for(int i = 0; i < 16; i++) {
+        int best = 0, best_distance = INT32_MAX;
+        for(int p = 0; p < 4; p++) {
+            int distance = 0;
+            for(int c = 0; c < 3; c++) {
+                int d = (int)bc_channel(texels[i], c) - palette[p][c];
+                distance += d * d;
+            }
+            if(distance < best_distance) {
+                best = p;
+                best_distance = distance;
+            }
+        }
+        indices |= (uint32_t)best << (2 * i);
+    }
+    out[0] = c0 | ((uint32_t)c1 << 16);
+    out[1] = indices;
+}
+
+// alpha 不写，由调用者决定
+inline void bc_decode_color(const uint32_t in[2], bool allow_three_colors, uint32_t texels[16]) {
+    uint16_t c0 = in[0] & 0xffff, c1 = in[0] >> 16;
+    int palette[4][4];
+    bc_color_palette(c0, c1, !allow_three_colors || c0 > c1, palette);
+    for(int i = 0; i < 16; i++) {
+        const int* p = palette[(in[1] >> (2 * i)) & 3];
+        texels[i] = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+    }
+}
+
+// a0 > a1 时 8 个插值，否则 6 个插值加 0 和 255
+inline void bc_alpha_palette(int a0, int a1, int palette[8]) {
+    palette[0] = a0;
+    palette[1] = a1;
+    if(a0 > a1) {
+        for(int i = 2; i < 8; i++) {
+            palette[i] = ((8 - i) * a0 + (i - 1) * a1) / 7;
+        }
+    } else {
+        for(int i = 2; i < 6; i++) {
+            palette[i] = ((6 - i) * a0 + (i - 1) * a1) / 5;
+        }
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+}
+
+inline void bc_encode_alpha(const uint32_t texels[16], uint32_t out[2]) {
+    int lo = 255, hi = 0;
+    for(int i = 0; i < 16; i++) {
+        int a = (int)bc_channel(texels[i], 3);
+        lo = std::min(lo, a);
+        hi = std::max(hi, a);
+    }
+
+    uint64_t bits = (uint64_t)hi | ((uint64_t)lo << 8);
+    if(hi > lo) {
+        int palette[8];
+        bc_alpha_palette(hi, lo, palette);
+        for(int i = 0; i < 16; i++) {
+            int a = (int)bc_channel(texels[i], 3);
+            int best = 0;
+            for(int p = 1; p < 8; p++) {
+                if(std::abs(a - palette[p]) < std::abs(a - palette[best])) best = p;
+            }
+            bits |= (uint64_t)best << (16 + 3 * i);
+        }
+    }
+    out[0] = (uint32_t)bits;
+    out[1] = (uint32_t)(bits >> 32);
+}
+
+inline void bc_decode_alpha(const uint32_t in[2], uint32_t texels[16]) {
+    uint64_t bits = in[0] | ((uint64_t)in[1] << 32);
+    int palette[8];
+    bc_alpha_palette(bits & 0xff, (bits >> 8) & 0xff, palette);
+    for(int i = 0; i < 16; i++) {
+        uint32_t a = (uint32_t)palette[(bits >> (16 + 3 * i)) & 7];
+        texels[i] = (texels[i] & 0x00ffffffu) | (a << 24);
+    }
+}
+
+inline void bc1_encode_block(const uint32_t texels[16], uint32_t out[BC1_BLOCK_WORDS]) {
+    bc_encode_color(texels, out);
+}
+
+inline void bc1_decode_block(const uint32_t in[BC1_BLOCK_WORDS], uint32_t texels[16]) {
+    bc_decode_color(in, true, texels);
+}
+
+inline void bc3_encode_block(const uint32_t texels[16], uint32_t out[BC3_BLOCK_WORDS]) {
+    bc_encode_alpha(texels, out);
+    bc_encode_color(texels, out + 2);
+}
+
+inline void bc3_decode_block(const uint32_t in[BC3_BLOCK_WORDS], uint32_t texels[16]) {
+    bc_decode_color(in + 2, false, texels);
+    bc_decode_alpha(in, texels);
+}
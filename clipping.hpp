@@ -0,0 +1,90 @@
+#pragma once
+
+#include "common_header.hpp"
+#include "matrix.hpp"
+#include <cstdint>
+
+// 裁剪空间中的顶点。bary 是它关于原三角形三个顶点的权重。
+// 属性在裁剪空间里是线性的，所以 resolve 时可以用 bary 把子三角形的重心坐标换算回原三角形。
+struct ClipVertex {
+    Vec4 clip;
+    Vec4 world;
+    float bary[3];
+
+    ClipVertex lerp(const ClipVertex& other, float t) const {
+        ClipVertex out;
+        out.clip = clip + (other.clip - clip) * t;
+        out.world = world + (other.world - world) * t;
+        for(int i = 0; i < 3; i++) {
+            out.bary[i] = bary[i] + (other.bary[i] - bary[i]) * t;
+        }
+        return out;
+    }
+};
+
+enum ClipPlane : uint32_t {
+    CLIP_NEAR   = 1 << 0,
+    CLIP_FAR    = 1 << 1,
+    CLIP_LEFT   = 1 << 2,
+    CLIP_RIGHT  = 1 << 3,
+    CLIP_BOTTOM = 1 << 4,
+    CLIP_TOP    = 1 << 5,
+};
+
+// 投影之后 w 就是相机空间的深度，所以近/远平面是 near <= w <= far。
+// x/y 方向只对超出 guard band（NDC 的 guard_band 倍）的三角形裁剪，其余的交给包围盒 clamp。
+struct ClipVolume {
+    static constexpr int N_PLANES = 6;
+    static constexpr int MAX_VERTICES = 3 + N_PLANES; // 每个平面最多多出一个顶点
+
+    float near;
+    float far;
+    float guard_band = 4;
+
+    // >= 0 为内侧
+    float distance(int plane, const Vec4& c) const {
+        switch(plane) {
+            case 0: return c[3] - near;
+            case 1: return far - c[3];
+            case 2: return guard_band * c[3] + c[0];
+            case 3: return guard_band * c[3] - c[0];
+            case 4: return guard_band * c[3] + c[1];
+            default: return guard_band * c[3] - c[1];
+        }
+    }
+
+    // 第 i 位为 1 表示在第 i 个平面外侧
+    uint32_t outcode(const Vec4& c) const {
+        uint32_t code = 0;
+        for(int plane = 0; plane < N_PLANES; plane++) {
+            if(distance(plane, c) < 0) code |= 1u << plane;
+        }
+        return code;
+    }
+
+    // Sutherland-Hodgman：依次用 planes 中的平面裁剪凸多边形 poly（n 个顶点），结果写回 poly，返回顶点数。
+    // poly 至少要有 MAX_VERTICES 的空间。
+    int clip_polygon(ClipVertex* poly, int n, uint32_t planes) const {
+        ClipVertex buffer[MAX_VERTICES];
+        for(int plane = 0; plane < N_PLANES && n > 0; plane++) {
+            if(!(planes & (1u << plane))) continue;
+
+            int m = 0;
+            for(int i = 0; i < n; i++) {
+                const ClipVertex& a = poly[i];
+                const ClipVertex& b = poly[(i + 1) % n];
+                float da = distance(plane, a.clip);
+                float db = distance(plane, b.clip);
+
+                if(da >= 0) buffer[m++] = a;
+                if((da >= 0) != (db >= 0)) {
+                    buffer[m++] = a.lerp(b, da / (da - db));
+                }
+            }
+
+            for(int i = 0; i < m; i++) poly[i] = buffer[i];
+            n = m;
+        }
+        return n;
+    }
+};
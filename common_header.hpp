@@ -1,8 +1,12 @@
-#define _CRTDBG_MAP_ALLOC
 #include <stdlib.h>
+
+// MSVC 的调试堆，其他编译器没有 <crtdbg.h>
+#ifdef _MSC_VER
+#define _CRTDBG_MAP_ALLOC
 #include <crtdbg.h>
+#endif
 
-#ifdef _DEBUG
+#if defined(_MSC_VER) && defined(_DEBUG)
 #define DBG_NEW new ( _NORMAL_BLOCK , __FILE__ , __LINE__ )
 // Replace _NORMAL_BLOCK with _CLIENT_BLOCK if you want the
 // allocations to be of _CLIENT_BLOCK type
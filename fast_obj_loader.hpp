@@ -0,0 +1,301 @@
+#pragma once
+
+#include "common_header.hpp"
+#include "OBJ_Loader.h"
+#include "utils.hpp"
+#include "mapped_file.hpp"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <array>
+#include <unordered_map>
+#include <charconv>
+#include <format>
+#include <algorithm>
+#include <iostream>
+
+// objl::Loader 的替代品：接口相同（LoadFile / LoadedMeshes / LoadedMaterials），输出可以直接交给 create_object_from_obj_loader_mesh。
+// 文件整体 mmap，数字用 from_chars 直接从缓冲区解析，逐行处理时不分配字符串。
+// 每个 mesh 内按 (position, uv, normal) 下标去重，输出带索引的顶点；objl 则是每个面角都复制一份顶点。
+// 分 mesh 的方式与 objl 相同：遇到 o / g 或 usemtl 时结束当前 mesh。四边形的三角化方式也与 objl 相同。
+class FastObjLoader {
+    // 按行遍历，去掉行尾的 \r
+    struct LineReader {
+        std::string_view text;
+        size_t pos = 0;
+        int line_no = 0;
+
+        bool next(std::string_view& line) {
+            if(pos >= text.size()) return false;
+            size_t end = text.find('\n', pos);
+            if(end == std::string_view::npos) end = text.size();
+            line = text.substr(pos, end - pos);
+            if(!line.empty() && line.back() == '\r') line.remove_suffix(1);
+            pos = end + 1;
+            line_no++;
+            return true;
+        }
+    };
+
+    static bool is_space(char c) { return c == ' ' || c == '\t'; }
+
+    static std::string_view trim(std::string_view s) {
+        while(!s.empty() && is_space(s.front())) s.remove_prefix(1);
+        while(!s.empty() && is_space(s.back())) s.remove_suffix(1);
+        return s;
+    }
+
+    // 拆出第一个 token，rest 是去掉首尾空白的剩余部分
+    static std::string_view first_token(std::string_view line, std::string_view& rest) {
+        line = trim(line);
+        size_t end = 0;
+        while(end < line.size() && !is_space(line[end])) end++;
+        rest = trim(line.substr(end));
+        return line.substr(0, end);
+    }
+
+    static bool parse_float(const char*& p, const char* end, float& value) {
+        while(p < end && is_space(*p)) p++;
+        if(p < end && *p == '+') p++;
+        auto [next, ec] = std::from_chars(p, end, value);
+        if(ec != std::errc()) return false;
+        p = next;
+        return true;
+    }
+
+    static bool parse_int(const char*& p, const char* end, int& value) {
+        if(p < end && *p == '+') p++;
+        auto [next, ec] = std::from_chars(p, end, value);
+        if(ec != std::errc()) return false;
+        p = next;
+        return true;
+    }
+
+    template<int K>
+    static bool parse_floats(std::string_view s, float (&out)[K]) {
+        const char* p = s.data();
+        const char* end = p + s.size();
+        for(int i = 0; i < K; i++) {
+            if(!parse_float(p, end, out[i])) return false;
+        }
+        return true;
+    }
+
+    static bool parse_floats(std::string_view s, float& out) {
+        float v[1];
+        if(!parse_floats(s, v)) return false;
+        out = v[0];
+        return true;
+    }
+
+    // OBJ 的下标从 1 开始，负数表示从末尾倒数
+    static int resolve_index(int index, size_t count) {
+        int resolved = index < 0 ? (int)count + index : index - 1;
+        return resolved >= 0 && resolved < (int)count ? resolved : -1;
+    }
+
+    struct VertexKey {
+        std::array<int, 3> indices;
+        bool operator==(const VertexKey&) const = default;
+    };
+
+    struct VertexKeyHash {
+        size_t operator()(const VertexKey& key) const {
+            uint64_t h = (uint32_t)key.indices[0];
+            h = h * 0x9E3779B97F4A7C15ull ^ (uint32_t)key.indices[1];
+            h = h * 0x9E3779B97F4A7C15ull ^ (uint32_t)key.indices[2];
+            return (size_t)(h ^ (h >> 29));
+        }
+    };
+
+    void load_materials(const std::string& path) {
+        MappedFile file(path);
+        LineReader reader { file.view() };
+
+        objl::Material material;
+        bool has_material = false;
+        std::string_view line;
+        while(reader.next(line)) {
+            std::string_view rest;
+            auto token = first_token(line, rest);
+            float v[3];
+
+            if(token == "newmtl") {
+                if(has_material) LoadedMaterials.push_back(material);
+                material = objl::Material();
+                material.name = rest;
+                has_material = true;
+            } else if((token == "Ka" || token == "Kd" || token == "Ks") && parse_floats(rest, v)) {
+                objl::Vector3 color(v[0], v[1], v[2]);
+                (token == "Ka" ? material.Ka : token == "Kd" ? material.Kd : material.Ks) = color;
+            } else if(token == "Ns") {
+                parse_floats(rest, material.Ns);
+            } else if(token == "Ni") {
+                parse_floats(rest, material.Ni);
+            } else if(token == "d") {
+                parse_floats(rest, material.d);
+            } else if(token == "illum") {
+                const char* p = rest.data();
+                parse_int(p, p + rest.size(), material.illum);
+            } else if(token == "map_Ka") {
+                material.map_Ka = rest;
+            } else if(token == "map_Kd") {
+                material.map_Kd = rest;
+            } else if(token == "map_Ks") {
+                material.map_Ks = rest;
+            } else if(token == "map_Ns") {
+                material.map_Ns = rest;
+            } else if(token == "map_d") {
+                material.map_d = rest;
+            } else if(token == "map_Bump" || token == "map_bump" || token == "bump") {
+                material.map_bump = rest;
+            }
+        }
+        if(has_material) LoadedMaterials.push_back(material);
+    }
+
+public:
+    std::vector<objl::Mesh> LoadedMeshes;
+    std::vector<objl::Material> LoadedMaterials;
+
+    bool LoadFile(const std::string& path) {
+        LoadedMeshes.clear();
+        LoadedMaterials.clear();
+
+        MappedFile file(path);
+        LineReader reader { file.view() };
+        auto directory = path.substr(0, path.find_last_of('/') + 1);
+
+        std::vector<objl::Vector3> positions;
+        std::vector<objl::Vector2> uvs;
+        std::vector<objl::Vector3> normals;
+
+        objl::Mesh mesh;
+        std::string mesh_name;
+        std::string material_name;
+        int part = 1;   // 同一个 o / g 里因为 usemtl 拆出的第几段
+        std::unordered_map<VertexKey, uint32_t, VertexKeyHash> dedup;
+
+        auto error = [&](std::string_view what) {
+            return simple_exception(std::format("error: {} in `{}` at line {}.", what, path, reader.line_no));
+        };
+
+        auto flush = [&]() {
+            if(mesh.Indices.empty()) return;
+            mesh.MeshName = part == 1 ? mesh_name : std::format("{}_{}", mesh_name, part);
+            auto material = std::find_if(LoadedMaterials.begin(), LoadedMaterials.end(),
+                [&](const objl::Material& m) { return m.name == material_name; });
+            if(material != LoadedMaterials.end()) mesh.MeshMaterial = *material;
+            LoadedMeshes.push_back(std::move(mesh));
+            mesh = objl::Mesh();
+            dedup.clear();
+        };
+
+        // 一个面的各个角：resolved 下标（没有时为 -1）
+        std::vector<VertexKey> corners;
+        std::vector<uint32_t> face;
+
+        std::string_view line;
+        while(reader.next(line)) {
+            std::string_view rest;
+            auto token = first_token(line, rest);
+            if(token.empty() || token[0] == '#') continue;
+
+            if(token == "v" || token == "vn") {
+                float v[3];
+                if(!parse_floats(rest, v)) throw error("invalid vector");
+                (token == "v" ? positions : normals).emplace_back(v[0], v[1], v[2]);
+            } else if(token == "vt") {
+                float v[2];
+                if(!parse_floats(rest, v)) throw error("invalid texture coordinate");
+                uvs.emplace_back(v[0], v[1]);
+            } else if(token == "f") {
+                corners.clear();
+                const char* p = rest.data();
+                const char* end = p + rest.size();
+                bool has_normals = true;
+                while(p < end) {
+                    while(p < end && is_space(*p)) p++;
+                    if(p == end) break;
+
+                    int index[3] = { 0, 0, 0 };
+                    if(!parse_int(p, end, index[0])) throw error("invalid face");
+                    for(int k = 1; k < 3 && p < end && *p == '/'; k++) {
+                        p++;
+                        if(p < end && *p != '/' && !is_space(*p) && !parse_int(p, end, index[k])) throw error("invalid face");
+                    }
+
+                    VertexKey key;
+                    key.indices[0] = resolve_index(index[0], positions.size());
+                    key.indices[1] = index[1] ? resolve_index(index[1], uvs.size()) : -1;
+                    key.indices[2] = index[2] ? resolve_index(index[2], normals.size()) : -1;
+                    if(key.indices[0] < 0 || (index[1] && key.indices[1] < 0) || (index[2] && key.indices[2] < 0)) {
+                        throw error("face index out of range");
+                    }
+                    has_normals = has_normals && key.indices[2] >= 0;
+                    corners.push_back(key);
+                }
+                if(corners.size() < 3) continue;
+
+                // 与 objl 一样：有角缺法线时，整个面都用前三个点算出的（未归一化的）面法线，这些顶点不参与去重
+                objl::Vector3 face_normal;
+                if(!has_normals) {
+                    auto& p0 = positions[corners[0].indices[0]];
+                    auto& p1 = positions[corners[1].indices[0]];
+                    auto& p2 = positions[corners[2].indices[0]];
+                    face_normal = objl::math::CrossV3(p0 - p1, p2 - p1);
+                }
+
+                face.clear();
+                for(auto& key: corners) {
+                    if(has_normals) {
+                        auto [it, inserted] = dedup.try_emplace(key, (uint32_t)mesh.Vertices.size());
+                        face.push_back(it->second);
+                        if(!inserted) continue;
+                    } else {
+                        face.push_back((uint32_t)mesh.Vertices.size());
+                    }
+
+                    objl::Vertex vertex;
+                    vertex.Position = positions[key.indices[0]];
+                    vertex.TextureCoordinate = key.indices[1] >= 0 ? uvs[key.indices[1]] : objl::Vector2(0, 0);
+                    vertex.Normal = has_normals ? normals[key.indices[2]] : face_normal;
+                    mesh.Vertices.push_back(vertex);
+                }
+
+                // 四边形按 objl 的方式切成 (0, 1, 3)、(1, 2, 3)，更多边的凸多边形按扇形切
+                auto triangle = [&](int a, int b, int c) {
+                    mesh.Indices.push_back(face[a]);
+                    mesh.Indices.push_back(face[b]);
+                    mesh.Indices.push_back(face[c]);
+                };
+                if(face.size() == 4) {
+                    triangle(0, 1, 3);
+                    triangle(1, 2, 3);
+                } else {
+                    for(size_t i = 1; i + 1 < face.size(); i++) triangle(0, (int)i, (int)i + 1);
+                }
+            } else if(token == "o" || token == "g") {
+                flush();
+                mesh_name = rest.empty() ? "unnamed" : std::string(rest);
+                part = 1;
+            } else if(token == "usemtl") {
+                if(!mesh.Indices.empty()) {
+                    flush();
+                    part++;
+                }
+                material_name = rest;
+            } else if(token == "mtllib") {
+                // 和 objl 一样，找不到材质文件时继续加载几何
+                try {
+                    load_materials(directory + std::string(rest));
+                } catch(const simple_exception& e) {
+                    std::cerr << e.what() << std::endl;
+                }
+            }
+        }
+        flush();
+
+        return !LoadedMeshes.empty();
+    }
+};
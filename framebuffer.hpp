@@ -0,0 +1,112 @@
+#pragma once
+
+#include "common_header.hpp"
+#include "image.hpp"
+#include "aligned_buffer.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cmath>
+
+// 可见性缓冲中的一个像素：最近的三角形（这一帧 setup 出来的三角形下标）以及屏幕空间重心坐标。
+// 属性插值和着色推迟到 resolve 阶段，每个可见像素只做一次。
+struct VisibilitySample {
+    static constexpr uint32_t EMPTY = 0xffffffffu;
+
+    uint32_t triangle;
+    float k2, k3;       // k1 = 1 - k2 - k3
+};
+
+// 跨帧复用的帧缓冲。depth 和 visibility 按 TILE_SIZE x TILE_SIZE 的 tile 排布：
+// 每个 tile 占一段连续内存，tile 内按行存放（x 方向连续）。这样一个 worker 处理的 tile 只落在自己那一段内存里。
+// color 是最终输出的图片，按 Image 自己的格式存放。
+//
+// block_max_depth / tile_max_depth 是深度的两级最大值（BLOCK_SIZE x BLOCK_SIZE 和整个 tile），
+// 一个三角形的最小深度不小于它们时，对应区域里不可能有像素通过深度测试。
+class FrameBuffer {
+public:
+    static constexpr int TILE_SIZE = 64;
+    static constexpr int BLOCK_SIZE = 8;
+    static constexpr int BLOCKS_PER_TILE = (TILE_SIZE / BLOCK_SIZE) * (TILE_SIZE / BLOCK_SIZE);
+
+private:
+    int w = 0;
+    int h = 0;
+    int tiles_x = 0;
+    int tiles_y = 0;
+
+public:
+    AlignedBuffer<float> depth;
+    AlignedBuffer<VisibilitySample> visibility;
+    AlignedBuffer<float> block_max_depth;
+    AlignedBuffer<float> tile_max_depth;
+    Image color;
+
+    // 尺寸不变时什么都不做，内容需要另外 clear
+    void resize(int width, int height) {
+        if(width == w && height == h) return;
+        w = width;
+        h = height;
+        tiles_x = (width + TILE_SIZE - 1) / TILE_SIZE;
+        tiles_y = (height + TILE_SIZE - 1) / TILE_SIZE;
+        size_t n = (size_t)tiles_x * tiles_y * TILE_SIZE * TILE_SIZE;
+        depth.resize(n);
+        visibility.resize(n);
+        block_max_depth.resize((size_t)tiles_x * tiles_y * BLOCKS_PER_TILE);
+        tile_max_depth.resize((size_t)tiles_x * tiles_y);
+        color = Image(width, height);
+    }
+
+    int width() const { return w; }
+    int height() const { return h; }
+    int n_tiles_x() const { return tiles_x; }
+    int n_tiles_y() const { return tiles_y; }
+    int n_tiles() const { return tiles_x * tiles_y; }
+
+    size_t index(int x, int y) const {
+        int tile = (y / TILE_SIZE) * tiles_x + x / TILE_SIZE;
+        return (size_t)tile * TILE_SIZE * TILE_SIZE + (y % TILE_SIZE) * TILE_SIZE + x % TILE_SIZE;
+    }
+
+    // 同一 tile 的同一行内，从 (x, y) 开始向右是连续的
+    float* depth_at(int x, int y) { return &depth[index(x, y)]; }
+    VisibilitySample& visibility_at(int x, int y) { return visibility[index(x, y)]; }
+
+    size_t block_index(int x, int y) const {
+        int tile = (y / TILE_SIZE) * tiles_x + x / TILE_SIZE;
+        constexpr int BLOCKS_X = TILE_SIZE / BLOCK_SIZE;
+        return (size_t)tile * BLOCKS_PER_TILE + (y % TILE_SIZE) / BLOCK_SIZE * BLOCKS_X + (x % TILE_SIZE) / BLOCK_SIZE;
+    }
+
+    float& block_max_depth_at(int x, int y) { return block_max_depth[block_index(x, y)]; }
+
+    // (x, y) 是 block 的左下角。深度写入之后调用
+    void update_block_max_depth(int x, int y) {
+        float m = -INFINITY;
+        for(int row = 0; row < BLOCK_SIZE; row++) {
+            const float* d = depth_at(x, y + row);
+            for(int i = 0; i < BLOCK_SIZE; i++) {
+                m = std::max(m, d[i]);
+            }
+        }
+        block_max_depth_at(x, y) = m;
+    }
+
+    void update_tile_max_depth(int tile) {
+        const float* b = block_max_depth.data() + (size_t)tile * BLOCKS_PER_TILE;
+        tile_max_depth[tile] = *std::max_element(b, b + BLOCKS_PER_TILE);
+    }
+
+    void clear_tile(int tile, float depth_value) {
+        size_t begin = (size_t)tile * TILE_SIZE * TILE_SIZE;
+        std::fill_n(depth.data() + begin, TILE_SIZE * TILE_SIZE, depth_value);
+        std::fill_n(visibility.data() + begin, TILE_SIZE * TILE_SIZE, VisibilitySample{VisibilitySample::EMPTY, 0, 0});
+        std::fill_n(block_max_depth.data() + (size_t)tile * BLOCKS_PER_TILE, BLOCKS_PER_TILE, depth_value);
+        tile_max_depth[tile] = depth_value;
+    }
+
+    void clear(float depth_value) {
+        for(int tile = 0; tile < n_tiles(); tile++) {
+            clear_tile(tile, depth_value);
+        }
+    }
+};
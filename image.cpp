@@ -49,6 +49,7 @@ Image& Image::operator=(const Image& other) {
     free(buffer);
     width = other.width;
     height = other.height;
+    n_channels = other.n_channels;
     buffer = (unsigned char*)malloc(n_channels * width * height);
     memcpy(buffer, other.buffer, n_channels * width * height);
     return *this;
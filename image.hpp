@@ -114,6 +114,7 @@ public:
 	Image(const Image& other) {
 		width = other.width;
 		height = other.height;
+		n_channels = other.n_channels;
 		buffer = (unsigned char*) malloc(n_channels * width * height);
 		memcpy(buffer, other.buffer, n_channels * width * height);
 
@@ -124,6 +125,7 @@ public:
 	Image(Image&& other) {
 		width = other.width;
 		height = other.height;
+		n_channels = other.n_channels;
 		buffer = other.buffer;
         this->from_file = other.from_file;
         other.from_file = false;
@@ -137,6 +139,7 @@ public:
 		free(buffer);
 		width = other.width;
 		height = other.height;
+		n_channels = other.n_channels;
 		buffer = other.buffer;
         this->from_file = true;
         other.from_file = false;
@@ -5,7 +5,9 @@
 #include "shader.hpp"
 #include "matrix.hpp"
 #include "OBJ_Loader.h"
+#include "texture_cache.hpp"
 #include <cmath>
+#include <tuple>
 
 Vec3 obj_ld_vec_to_vec3(const objl::Vector3& vec) {
 	return { vec.X, vec.Y, vec.Z };
@@ -26,21 +28,19 @@ create_object_from_obj_loader_mesh(const objl::Mesh& mesh, const std::string& ob
 	
 	auto basepath = obj_path.substr(0, obj_path.find_last_of('/'));
 
-	std::shared_ptr<Image> map_Kd = nullptr, map_Ka = nullptr, map_Ks = nullptr, map_bump = nullptr;
-	
-	if(!mesh.MeshMaterial.map_Kd.empty()) 
-		map_Kd = std::make_shared<Image>(basepath + "/" + mesh.MeshMaterial.map_Kd);
-	
-	if(!mesh.MeshMaterial.map_Ka.empty()) 
-		map_Ka = std::make_shared<Image>(basepath + "/" + mesh.MeshMaterial.map_Ka);
+	auto material = std::make_shared<BlinnPhongMaterial>();
+	material->material = mesh.MeshMaterial;
 
-	if(!mesh.MeshMaterial.map_Ks.empty()) 
-		map_Ks = std::make_shared<Image>(basepath + "/" + mesh.MeshMaterial.map_Ka);
-
-	if(!mesh.MeshMaterial.map_bump.empty()) 
-		map_bump = std::make_shared<Image>(basepath + "/" + mesh.MeshMaterial.map_bump);
+	// 纹理由全局的 TextureCache 共享，同一个文件在所有 mesh 之间（以及重复加载模型时）只解码一次
+	auto load_texture = [&](const std::string& name) -> std::shared_ptr<const Texture> {
+		if(name.empty()) return nullptr;
+		return TextureCache::instance().load(basepath + "/" + name);
+	};
 
-	Image::reset_cache();
+	material->map_Kd = load_texture(mesh.MeshMaterial.map_Kd);
+	material->map_Ka = load_texture(mesh.MeshMaterial.map_Ka);
+	material->map_Ks = load_texture(mesh.MeshMaterial.map_Ks);
+	material->map_bump = load_texture(mesh.MeshMaterial.map_bump);
 
 	// 本质问题是 TBN 其实是一个面属性，不是一个点属性。一般应该如何解决这种问题？
 	// 这里的处理方式：
@@ -49,11 +49,7 @@ create_object_from_obj_loader_mesh(const objl::Mesh& mesh, const std::string& ob
 	for(auto vert: mesh.Vertices) {
 		BlinnPhongAttribute attr;
 		attr.vertex = vert;
-		attr.map_Kd = map_Kd;
-		attr.map_Ka = map_Ka;
-		attr.map_Ks = map_Ks;
-		attr.material = mesh.MeshMaterial;
-		attr.map_bump = map_bump;
+		attr.material = material;
 		object.vertices.push_back(attr);
 	}
 	
@@ -65,14 +61,16 @@ create_object_from_obj_loader_mesh(const objl::Mesh& mesh, const std::string& ob
 		int v2 = mesh.Indices[i + 1];
 		int v3 = mesh.Indices[i + 2];
 
+		// 轮换而不是交换，保持三角形的绕序（背面剔除依赖它）
 		if(!TBN_set[v1]) {
 			// do nothing
 		}else if(!TBN_set[v2]){
-			std::swap(v1, v2);
+			std::tie(v1, v2, v3) = std::make_tuple(v2, v3, v1);
 		}else if(!TBN_set[v3]){
-			std::swap(v1, v3);
+			std::tie(v1, v2, v3) = std::make_tuple(v3, v1, v2);
 		}else{
 			object.vertices.push_back(object.vertices[v1]);
+			TBN_set.push_back(false);
 			v1 = object.vertices.size() - 1;
 		}
 		TBN_set[v1] = true;
@@ -83,16 +81,16 @@ create_object_from_obj_loader_mesh(const objl::Mesh& mesh, const std::string& ob
 		auto B = obj_ld_vec_to_vec3(object.vertices[v2].vertex.Position);
 		auto C = obj_ld_vec_to_vec3(object.vertices[v3].vertex.Position);
 
-		auto y1 = B - A;
-		auto y2 = C - A;
+		Vec3 y1 = B - A;
+		Vec3 y2 = C - A;
 		auto val_u1 = object.vertices[v2].vertex.TextureCoordinate.X - object.vertices[v1].vertex.TextureCoordinate.X;
 		auto val_u2 = object.vertices[v3].vertex.TextureCoordinate.X - object.vertices[v1].vertex.TextureCoordinate.X;
 		auto val_v1 = object.vertices[v2].vertex.TextureCoordinate.Y - object.vertices[v1].vertex.TextureCoordinate.Y;
 		auto val_v2 = object.vertices[v3].vertex.TextureCoordinate.Y - object.vertices[v1].vertex.TextureCoordinate.Y;
 
-		auto u = (y2 * val_v1 - y1 * val_v2) * (1.0 / (val_v1 * val_u2 - val_u1 * val_v2));
-		auto v = (y2 * val_u1 - y1 * val_u2) * (1.0 / (val_u1 * val_v2 - val_v1 * val_u2));
-		auto n = cross_product(u, v).normalized() * sqrt(u.norm2() * v.norm2());
+		Vec3 u = (y2 * val_v1 - y1 * val_v2) * (1.0 / (val_v1 * val_u2 - val_u1 * val_v2));
+		Vec3 v = (y2 * val_u1 - y1 * val_u2) * (1.0 / (val_u1 * val_v2 - val_v1 * val_u2));
+		Vec3 n = cross_product(u, v).normalized() * sqrt(u.norm2() * v.norm2());
 
 		object.vertices[v1].TBN = Mat3::hcat(u, v, n);
 	}
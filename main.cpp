@@ -7,6 +7,7 @@
 #include "OBJ_Loader.h"
 #include "blinn_phong.hpp"
 #include "ld_obj_loader.hpp"
+#include "fast_obj_loader.hpp"
 #include "utils.hpp"
 #include "display.hpp"
 
@@ -16,7 +17,7 @@ Vec3 correct(const Vec3& n, const Vec3& a) {
 
 
 int entrance(int argc, char** argv) {
-	objl::Loader loader;
+	FastObjLoader loader;
 	Rasterizer<BlinnPhongUniform> rasterizer;
 /*
 	Vec3 camera_pos {0, 100, 0};
@@ -62,6 +63,10 @@ int entrance(int argc, char** argv) {
 	std::string filename = "out.bmp";
 	std::string modelpath = "../../../samples/Keqing/Keqing.obj";
 
+	// 对之后 load 的模型生效
+	CullMode cull_mode = CullMode::None;
+	const char* cull_mode_names[] = { "none", "back", "front" };
+
 	ImageDisplay display(width, height);
 
 
@@ -98,9 +103,17 @@ int entrance(int argc, char** argv) {
 							BlinnPhongFShader
 						>(mesh, modelpath);
 						// TODO: 这不是常见的模型方向指定方式
-						rasterizer.addObject(loadedObject, { {1, 0, 0}, {0, 1, 0 }, {0, 0, 1 } }, { 0, 0, 0 });
+						rasterizer.addObject(loadedObject, { {1, 0, 0}, {0, 1, 0 }, {0, 0, 1 } }, { 0, 0, 0 }, cull_mode);
 					}
 					std::cerr << "loaded: " << loader.LoadedMeshes.size() << " meshes" << std::endl;
+				} else if (args.size() == 2 && args[0] == "cull") {
+					auto it = std::find(std::begin(cull_mode_names), std::end(cull_mode_names), args[1]);
+					if (it == std::end(cull_mode_names)) {
+						cout << "unsupported cull mode" << endl;
+					} else {
+						cull_mode = (CullMode)(it - std::begin(cull_mode_names));
+						std::cerr << "cull mode applies to models loaded afterwards" << endl;
+					}
 				} else if (args.size() == 4 && args[0] == "cdir") {
 					camera_dir = {stof(args[1]), stof(args[2]), stof(args[3])};
 					camera_top = correct(camera_dir, camera_top);
@@ -172,6 +185,7 @@ int entrance(int argc, char** argv) {
 						"height             %d\n"
 						"[I/O]\n"  
 						"model(load)        %s\n"
+						"cull(cull)         %s\n"
 						"output(w)          %s\n",
 
 						camera_pos[0], camera_pos[1], camera_pos[2], 
@@ -181,7 +195,7 @@ int entrance(int argc, char** argv) {
 						light_color.r, light_color.g, light_color.b,
 						z_near, z_far, fovY, aspect_ratio,
 						width, height,
-						modelpath.c_str(), filename.c_str()
+						modelpath.c_str(), cull_mode_names[(int)cull_mode], filename.c_str()
 					);
 				} else if(args.size() == 0) {
 					// do nothing
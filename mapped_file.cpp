@@ -0,0 +1,67 @@
+#include "common_header.hpp"
+#include "mapped_file.hpp"
+#include "utils.hpp"
+#include <format>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::string& path) {
+#ifdef _WIN32
+    file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    LARGE_INTEGER size;
+    if(file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &size)) {
+        release();
+        throw simple_exception(std::format("error: cannot open `{}`.", path));
+    }
+    length = (size_t)size.QuadPart;
+    if(length == 0) return;
+    mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if(mapping) ptr = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+    fd = open(path.c_str(), O_RDONLY);
+    struct stat st;
+    if(fd < 0 || fstat(fd, &st) != 0) {
+        release();
+        throw simple_exception(std::format("error: cannot open `{}`.", path));
+    }
+    length = (size_t)st.st_size;
+    if(length == 0) return;
+    void* p = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(p != MAP_FAILED) {
+        ptr = (const char*)p;
+        madvise(p, length, MADV_SEQUENTIAL);
+    }
+#endif
+    if(!ptr) {
+        release();
+        throw simple_exception(std::format("error: cannot map `{}`.", path));
+    }
+}
+
+void MappedFile::release() {
+#ifdef _WIN32
+    if(ptr) UnmapViewOfFile(ptr);
+    if(mapping) CloseHandle(mapping);
+    if(file && file != INVALID_HANDLE_VALUE) CloseHandle(file);
+    mapping = nullptr;
+    file = nullptr;
+#else
+    if(ptr) munmap((void*)ptr, length);
+    if(fd >= 0) close(fd);
+    fd = -1;
+#endif
+    ptr = nullptr;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "common_header.hpp"
+#include <string>
+#include <string_view>
+
+// 只读映射整个文件，生命周期内 view() 一直有效。
+// 平台相关的部分在 mapped_file.cpp 里：<windows.h> 会把 near / far 定义成宏，不能出现在头文件的包含链中。
+class MappedFile {
+    const char* ptr = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    void* file = nullptr;       // HANDLE
+    void* mapping = nullptr;    // HANDLE
+#else
+    int fd = -1;
+#endif
+
+    void release();
+
+public:
+    explicit MappedFile(const std::string& path);
+
+    ~MappedFile() {
+        release();
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    std::string_view view() const { return { ptr, ptr ? length : 0 }; }
+};
@@ -3,8 +3,19 @@
 #include "common_header.hpp"
 #include <vector>
 #include <cmath>
-#include <initializer_list>
+#include <concepts>
 #include <array>
+#include <utility>
+#include <functional>
+#include <type_traits>
+
+#if defined(__SSE__) || defined(_M_X64)
+#define MATRIX_SSE 1
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON)
+#define MATRIX_NEON 1
+#include <arm_neon.h>
+#endif
 
 template<int M, int N, typename ConstT>
 requires ( std::same_as<ConstT, float> || std::same_as<ConstT, const float> )
@@ -67,42 +78,155 @@ namespace std {
     }
 }
 
+// 常量求值时用的 sqrt（牛顿迭代），运行时仍走 sqrt，结果与原来逐位一致
+constexpr float matrix_sqrt(float x) {
+    if(!std::is_constant_evaluated()) return sqrt(x);
+    if(!(x > 0)) return x == 0 ? 0.0f : NAN;
+    if(x == INFINITY) return x;
+    double r = x >= 1 ? x : 1.0, prev = 0;
+    while(r != prev) {
+        prev = r;
+        r = 0.5 * (r + x / r);
+    }
+    return (float)r;
+}
+
+// a、b、out 都是 16 字节对齐、按行存放的 4x4 / 4x1 矩阵
+#if defined(MATRIX_SSE)
+inline void mat4_mul_vec4(const float* a, const float* v, float* out) {
+    // 先按行乘，再转置成按列，依次相加：与标量的 j 循环顺序相同
+    __m128 vec = _mm_load_ps(v);
+    __m128 p0 = _mm_mul_ps(_mm_load_ps(a + 0), vec);
+    __m128 p1 = _mm_mul_ps(_mm_load_ps(a + 4), vec);
+    __m128 p2 = _mm_mul_ps(_mm_load_ps(a + 8), vec);
+    __m128 p3 = _mm_mul_ps(_mm_load_ps(a + 12), vec);
+    _MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+    _mm_store_ps(out, _mm_add_ps(_mm_add_ps(_mm_add_ps(p0, p1), p2), p3));
+}
+
+inline void mat4_mul_mat4(const float* a, const float* b, float* out) {
+    __m128 b0 = _mm_load_ps(b + 0), b1 = _mm_load_ps(b + 4);
+    __m128 b2 = _mm_load_ps(b + 8), b3 = _mm_load_ps(b + 12);
+    for(int i = 0; i < 4; i++) {
+        const float* row = a + 4 * i;
+        __m128 acc = _mm_mul_ps(_mm_set1_ps(row[0]), b0);
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(row[1]), b1));
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(row[2]), b2));
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(row[3]), b3));
+        _mm_store_ps(out + 4 * i, acc);
+    }
+}
+#elif defined(MATRIX_NEON)
+inline void mat4_mul_vec4(const float* a, const float* v, float* out) {
+    // vld4q 直接把四行拆成四列
+    float32x4x4_t cols = vld4q_f32(a);
+    float32x4_t acc = vmulq_n_f32(cols.val[0], v[0]);
+    acc = vaddq_f32(acc, vmulq_n_f32(cols.val[1], v[1]));
+    acc = vaddq_f32(acc, vmulq_n_f32(cols.val[2], v[2]));
+    acc = vaddq_f32(acc, vmulq_n_f32(cols.val[3], v[3]));
+    vst1q_f32(out, acc);
+}
+
+inline void mat4_mul_mat4(const float* a, const float* b, float* out) {
+    float32x4_t b0 = vld1q_f32(b + 0), b1 = vld1q_f32(b + 4);
+    float32x4_t b2 = vld1q_f32(b + 8), b3 = vld1q_f32(b + 12);
+    for(int i = 0; i < 4; i++) {
+        const float* row = a + 4 * i;
+        float32x4_t acc = vmulq_n_f32(b0, row[0]);
+        acc = vaddq_f32(acc, vmulq_n_f32(b1, row[1]));
+        acc = vaddq_f32(acc, vmulq_n_f32(b2, row[2]));
+        acc = vaddq_f32(acc, vmulq_n_f32(b3, row[3]));
+        vst1q_f32(out + 4 * i, acc);
+    }
+}
+#endif
+
+// 逐元素的表达式模板（+、-、乘标量）。a * k + b * k2 这样的链不产生中间矩阵，
+// 赋值或转换成 Matrix 时在一个循环里逐元素算完。
+// 左值 Matrix 按引用保存，右值 Matrix（比如 to_vec3_as_pos 的结果）按值保存，表达式节点本身也按值保存。
+template<int M, int N>
+class Matrix;
+
+struct MatrixExpressionTag {};
+
+template<typename T>
+struct is_matrix : std::false_type {};
+
+template<int M, int N>
+struct is_matrix<Matrix<M, N>> : std::true_type {};
+
+template<typename T>
+concept MatrixExpression = std::derived_from<T, MatrixExpressionTag>;
+
+template<typename T>
+concept MatrixOperand = is_matrix<T>::value || MatrixExpression<T>;
+
+// 注意：`auto x = a - b` 得到的是未求值的表达式，a、b 是左值时只保存了引用。
+// x 活得比 a、b 长，或者之后改了 a、b，x 的值就跟着变；多次使用 x 也会每次重新计算整条链。
+// 需要保存结果时写成 Vec3 / Matrix 类型，或者调用 .eval()。
+template<typename T>
+using MatrixLeaf = std::conditional_t<
+    is_matrix<std::remove_cvref_t<T>>::value && std::is_lvalue_reference_v<T>,
+    const std::remove_cvref_t<T>&,
+    std::remove_cvref_t<T>
+>;
+
+// Vec4 / Mat4 的每一行正好是一个 128 位寄存器，按 16 字节对齐；Mat4 * Vec4、Mat4 * Mat4 走 SSE / NEON。
+// 累加顺序与标量循环相同，结果逐位一致。
+// 除了 inversed 和 slice 相关的接口，都可以在编译期求值；常量求值时不走 SIMD。
 template<int M, int N>
 class Matrix {
-    float data[M][N];
+    static constexpr size_t ALIGN = (M * N) % 4 == 0 ? 16 : alignof(float);
+
+    alignas(ALIGN) float data[M][N];
+
+    struct Uninitialized {};
+    constexpr explicit Matrix(Uninitialized) {}
+
+    // 按行展开的第 k 个元素。常量求值不允许越过 data[i] 做指针运算，所以不用 raw()[k]
+    constexpr float& element(int k) { return data[k / N][k % N]; }
 public:
     static constexpr int ShapeM = M;
     static constexpr int ShapeN = N;
 
-    Matrix(){
-        memset(data, 0, sizeof(data));
+    constexpr Matrix(): data{} {}
+
+    constexpr Matrix(const Matrix& other) = default;
+    constexpr Matrix& operator=(const Matrix& other) = default;
+
+    // 不清零，调用者负责写满所有元素
+    static constexpr Matrix uninitialized() {
+        return Matrix(Uninitialized{});
     }
 
-    Matrix(const Matrix& other){
-        memcpy(data, other.data, sizeof(data));
+    template<MatrixExpression E>
+    requires (E::ShapeM == M && E::ShapeN == N)
+    constexpr Matrix(const E& expr) {
+        for(int k = 0; k < M * N; k++) element(k) = expr.at(k);
     }
 
-    // 破坏了静态检查。不过 API 会比较易用。
-    Matrix(const std::initializer_list<float>& init) requires (N == 1) {
-        if(init.size() != M) throw "unmatch size";
-        
-        int i = 0;
-        for(auto val: init) {
-            data[i++][0] = val;
-        }
+    // 逐元素求值，a = a + b 这样的别名也是安全的
+    template<MatrixExpression E>
+    requires (E::ShapeM == M && E::ShapeN == N)
+    constexpr Matrix& operator=(const E& expr) {
+        for(int k = 0; k < M * N; k++) element(k) = expr.at(k);
+        return *this;
     }
 
-    // 破坏了静态检查。不过 API 会比较易用。
-    Matrix(const std::initializer_list<std::initializer_list<float>>& init) {
-        if(init.size() != M) throw "unmatch size";
-        int i = 0, j = 0;
-        for(auto row: init) {
-            if(row.size() != N) throw "unmatch size";
-            for(auto val: row) {
-                data[i][j++] = val;
+    // Vec3{ x, y, z }：元素个数在编译期检查
+    template<typename... T>
+    requires (N == 1 && sizeof...(T) == M && (std::convertible_to<T, float> && ...))
+    constexpr Matrix(T... values): data{ { (float)values }... } {}
+
+    // Mat3{ {a, b, c}, {d, e, f}, {g, h, i} }：行数和每行的长度都在编译期检查
+    template<size_t... K>
+    requires (sizeof...(K) == M && ((K == N) && ...))
+    constexpr Matrix(const float (&... rows)[K]) {
+        const float* init[M] = { rows... };
+        for(int i = 0; i < M; i++) {
+            for(int j = 0; j < N; j++) {
+                data[i][j] = init[i][j];
             }
-            i++;
-            j = 0;
         }
     }
 
@@ -115,14 +239,14 @@ public:
     }
 
     template <typename ...Cols>
-    static Matrix hcat(const Cols&... cols) {
+    static constexpr Matrix hcat(const Cols&... cols) {
         Matrix target;
         Matrix::make_hcat<0, Cols...>(target, cols...);
         return target;
     }
 
     template <int StartAt, typename FirstCol, typename ...Cols> 
-    static void make_hcat(Matrix& target, const FirstCol& firstcol, const Cols&... cols) 
+    static constexpr void make_hcat(Matrix& target, const FirstCol& firstcol, const Cols&... cols) 
     requires (StartAt + FirstCol::ShapeN <= N && FirstCol::ShapeM == M) {
         for(int i = 0; i < M; i++) {
             for(int j = 0; j < FirstCol::ShapeN; j++) {
@@ -133,7 +257,7 @@ public:
     }
 
     template <int StartAt, typename FirstCol> 
-    static void make_hcat(Matrix& target, const FirstCol& firstcol) 
+    static constexpr void make_hcat(Matrix& target, const FirstCol& firstcol) 
     requires (StartAt + FirstCol::ShapeN == N && FirstCol::ShapeM == M) {
         for(int i = 0; i < M; i++) {
             for(int j = 0; j < FirstCol::ShapeN; j++) {
@@ -142,25 +266,31 @@ public:
         }
     }
 
-    float& operator[](const std::pair<int, int>& index) {
+    constexpr float& operator[](const std::pair<int, int>& index) {
         return data[index.first][index.second];
     }
 
-    float operator[](const std::pair<int, int>& index) const {
+    constexpr float operator[](const std::pair<int, int>& index) const {
         return data[index.first][index.second];   
     }
 
     //template<>
-    float& operator[](int index) requires (N == 1) {
+    constexpr float& operator[](int index) requires (N == 1) {
         return data[index][0];
     }
 
     // /template<>
-    float operator[](int index) const requires (N == 1) {
+    constexpr float operator[](int index) const requires (N == 1) {
         return data[index][0];
     }
 
-    Matrix<N, M> transposed() { 
+    // 按行连续的 M * N 个 float
+    constexpr float* raw() { return &data[0][0]; }
+    constexpr const float* raw() const { return &data[0][0]; }
+
+    constexpr float at(int k) const { return data[k / N][k % N]; }
+
+    constexpr Matrix<N, M> transposed() const { 
         Matrix<N, M> out;
         for(int i = 0; i < M; i++)
             for(int j = 0; j < N; j++)
@@ -169,7 +299,18 @@ public:
     }
 
     template<int O>
-    Matrix<N, O> operator*(const Matrix<N, O>& rhs) const {
+    constexpr Matrix<M, O> operator*(const Matrix<N, O>& rhs) const {
+#if defined(MATRIX_SSE) || defined(MATRIX_NEON)
+        if constexpr (M == 4 && N == 4 && (O == 1 || O == 4)) if(!std::is_constant_evaluated()) {
+            auto mat = Matrix<M, O>::uninitialized();
+            if constexpr (O == 1) {
+                mat4_mul_vec4(raw(), rhs.raw(), mat.raw());
+            } else {
+                mat4_mul_mat4(raw(), rhs.raw(), mat.raw());
+            }
+            return mat;
+        }
+#endif
         Matrix<M, O> mat;
 
         for(int i = 0; i < M; i++) {
@@ -182,7 +323,7 @@ public:
         return mat;
     }
 
-    Matrix& operator*=(float k) {
+    constexpr Matrix& operator*=(float k) {
         for(int i = 0; i < M; i++) {
             for(int j = 0; j < N; j++) {
                 data[i][j] *= k;
@@ -191,37 +332,17 @@ public:
         return *this;
     }
 
-    Matrix operator*(float k) const {
-        Matrix rst = *this;
-        rst *= k;
-        return rst;
-    }
-
-    Matrix& operator+=(const Matrix& rhs) {
-        for(int i = 0; i < M; i++) {
-            for(int j = 0; j < N; j++) {
-                data[i][j] += rhs.data[i][j];
-            }
-        }
+    template<typename E>
+    requires MatrixOperand<E> && (E::ShapeM == M && E::ShapeN == N)
+    constexpr Matrix& operator+=(const E& rhs) {
+        for(int k = 0; k < M * N; k++) element(k) += rhs.at(k);
         return *this;
     }
 
-    Matrix operator+(const Matrix& rhs) const {
-        auto lhs = *this;
-        return lhs += rhs;
-    }
-
-    Matrix operator-(const Matrix& rhs) const {
-        Matrix out = *this;
-        return out -= rhs;
-    }
-
-    Matrix& operator-=(const Matrix& rhs) {
-        for(int i = 0; i < M; i++) {
-            for(int j = 0; j < N; j++) {
-                data[i][j] -= rhs.data[i][j];
-            }
-        }
+    template<typename E>
+    requires MatrixOperand<E> && (E::ShapeM == M && E::ShapeN == N)
+    constexpr Matrix& operator-=(const E& rhs) {
+        for(int k = 0; k < M * N; k++) element(k) -= rhs.at(k);
         return *this;
     }
 
@@ -235,7 +356,7 @@ public:
         return *this;
     }
 
-    static Matrix Identity() 
+    static constexpr Matrix Identity() 
     requires (M == N){
         Matrix out;
         for(int i = 0; i < M; i++) {
@@ -244,7 +365,7 @@ public:
         return out;
     };
 
-    float norm2_squared() const {
+    constexpr float norm2_squared() const {
         float sum = 0;
         for(int i = 0; i < M; i++) {
             for(int j = 0; j < N; j++) {
@@ -254,19 +375,19 @@ public:
         return sum;
     }
 
-    float norm2() const {
-        return sqrt(norm2_squared());
+    constexpr float norm2() const {
+        return matrix_sqrt(norm2_squared());
     }
 
-    Matrix& operator/=(float x) {
+    constexpr Matrix& operator/=(float x) {
         return (*this) *= 1/x;
     }
 
-    Matrix& normalize() requires ( N == 1 ) {
+    constexpr Matrix& normalize() requires ( N == 1 ) {
         return (*this) /= norm2();
     }
 
-    Matrix normalized() const requires ( N == 1 ) {
+    constexpr Matrix normalized() const requires ( N == 1 ) {
         auto out = *this;
         return out /= norm2();
     }
@@ -344,7 +465,79 @@ public:
 
 template<int M, int N>
 Matrix<M, N> operator*(const MatrixSlice<M, N, float>& slice, float k) {
-    return Matrix<M, N>(slice) * k;
+    Matrix<M, N> out(slice);
+    return out *= k;
+}
+
+// 表达式节点的公共部分：按 Matrix 的只读接口访问，结果需要多次使用时先 eval()
+template<typename Derived, int M, int N>
+struct MatrixExpressionBase : MatrixExpressionTag {
+    static constexpr int ShapeM = M;
+    static constexpr int ShapeN = N;
+
+    constexpr float at(int k) const { return static_cast<const Derived&>(*this).at(k); }
+
+    constexpr Matrix<M, N> eval() const { return Matrix<M, N>(static_cast<const Derived&>(*this)); }
+
+    constexpr float operator[](const std::pair<int, int>& index) const { return at(index.first * N + index.second); }
+    constexpr float operator[](int index) const requires (N == 1) { return at(index); }
+
+    constexpr float norm2_squared() const {
+        float sum = 0;
+        for(int k = 0; k < M * N; k++) {
+            float v = at(k);
+            sum += v * v;
+        }
+        return sum;
+    }
+
+    constexpr float norm2() const { return matrix_sqrt(norm2_squared()); }
+
+    constexpr Matrix<M, N> normalized() const requires (N == 1) { return eval().normalized(); }
+};
+
+template<typename Op, typename L, typename R>
+struct MatrixBinaryExpression : MatrixExpressionBase<MatrixBinaryExpression<Op, L, R>,
+                                                     std::remove_cvref_t<L>::ShapeM, std::remove_cvref_t<L>::ShapeN> {
+    L lhs;
+    R rhs;
+
+    template<typename A, typename B>
+    constexpr MatrixBinaryExpression(A&& a, B&& b): lhs(std::forward<A>(a)), rhs(std::forward<B>(b)) {}
+
+    constexpr float at(int k) const { return Op{}(lhs.at(k), rhs.at(k)); }
+};
+
+template<typename E>
+struct MatrixScaledExpression : MatrixExpressionBase<MatrixScaledExpression<E>,
+                                                     std::remove_cvref_t<E>::ShapeM, std::remove_cvref_t<E>::ShapeN> {
+    E expr;
+    float k;
+
+    template<typename A>
+    constexpr MatrixScaledExpression(A&& a, float k): expr(std::forward<A>(a)), k(k) {}
+
+    constexpr float at(int i) const { return expr.at(i) * k; }
+};
+
+template<typename L, typename R>
+requires MatrixOperand<std::remove_cvref_t<L>> && MatrixOperand<std::remove_cvref_t<R>> &&
+    (std::remove_cvref_t<L>::ShapeM == std::remove_cvref_t<R>::ShapeM && std::remove_cvref_t<L>::ShapeN == std::remove_cvref_t<R>::ShapeN)
+constexpr auto operator+(L&& lhs, R&& rhs) {
+    return MatrixBinaryExpression<std::plus<float>, MatrixLeaf<L>, MatrixLeaf<R>>(std::forward<L>(lhs), std::forward<R>(rhs));
+}
+
+template<typename L, typename R>
+requires MatrixOperand<std::remove_cvref_t<L>> && MatrixOperand<std::remove_cvref_t<R>> &&
+    (std::remove_cvref_t<L>::ShapeM == std::remove_cvref_t<R>::ShapeM && std::remove_cvref_t<L>::ShapeN == std::remove_cvref_t<R>::ShapeN)
+constexpr auto operator-(L&& lhs, R&& rhs) {
+    return MatrixBinaryExpression<std::minus<float>, MatrixLeaf<L>, MatrixLeaf<R>>(std::forward<L>(lhs), std::forward<R>(rhs));
+}
+
+template<typename E>
+requires MatrixOperand<std::remove_cvref_t<E>>
+constexpr auto operator*(E&& expr, float k) {
+    return MatrixScaledExpression<MatrixLeaf<E>>(std::forward<E>(expr), k);
 }
 
 // 如何只对某个成员函数进行特化？
@@ -355,8 +548,8 @@ using Vec4 = Matrix<4, 1>;
 using Mat3 = Matrix<3, 3>;
 using Mat4 = Matrix<4, 4>;
 
-Vec3 cross_product(const Vec3& vec31, const Vec3& vec32) {
-    Vec3 mat;
+constexpr Vec3 cross_product(const Vec3& vec31, const Vec3& vec32) {
+    auto mat = Vec3::uninitialized();
     mat[0] = vec31[1] * vec32[2] - vec32[1] * vec31[2];
     mat[1] = vec31[2] * vec32[0] - vec32[2] * vec31[0];
     mat[2] = vec31[0] * vec32[1] - vec32[0] * vec31[1];
@@ -364,7 +557,7 @@ Vec3 cross_product(const Vec3& vec31, const Vec3& vec32) {
 }
 
 template <int dim> 
-float dot_product(const Matrix<dim, 1>& vec1, const Matrix<dim, 1>& vec2) {
+constexpr float dot_product(const Matrix<dim, 1>& vec1, const Matrix<dim, 1>& vec2) {
     float sum = 0;
     for(int i = 0; i < dim; i++) {
         sum += vec1[i] * vec2[i];
@@ -372,27 +565,28 @@ float dot_product(const Matrix<dim, 1>& vec1, const Matrix<dim, 1>& vec2) {
     return sum;
 };
 
-Vec4 to_vec4_as_pos(const Vec3& vec) {
-    Vec4 mat;
+constexpr Vec4 to_vec4_as_pos(const Vec3& vec) {
+    auto mat = Vec4::uninitialized();
     for(int i = 0; i < 3; i++) mat[i] = vec[i];
     mat[3] = 1;
     return mat;
 }
 
-Vec4 to_vec4_as_dir(const Vec3& vec) {
-    Vec4 mat;
+constexpr Vec4 to_vec4_as_dir(const Vec3& vec) {
+    auto mat = Vec4::uninitialized();
     for(int i = 0; i < 3; i++) mat[i] = vec[i];
+    mat[3] = 0;
     return mat;
 }
 
-Vec3 to_vec3_as_dir(const Vec4& vec) {
-    Vec3 mat;
+constexpr Vec3 to_vec3_as_dir(const Vec4& vec) {
+    auto mat = Vec3::uninitialized();
     for(int i = 0; i < 3; i++) mat[i] = vec[i];
     return mat;
 }
 
-Vec3 to_vec3_as_pos(const Vec4& vec) {
-    Vec3 mat;
+constexpr Vec3 to_vec3_as_pos(const Vec4& vec) {
+    auto mat = Vec3::uninitialized();
     for(int i = 0; i < 3; i++) mat[i] = vec[i] / vec[3];
     return mat;
 }
@@ -0,0 +1,158 @@
+#pragma once
+
+#include "common_header.hpp"
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define RASTER_KERNELS_X86 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define RASTER_TARGET_AVX2
+#else
+#include <immintrin.h>
+#define RASTER_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+// 一段连续像素（最多 SPAN_WIDTH 个）的覆盖 + 深度测试。
+// 第 i 个像素的边函数为 e[j] + step[j] * i，深度为 sum(e[j] * inv_area * z[j])，与标量路径的算式一致，
+// 因此各个实现给出的结果逐位相同。
+struct SpanTest {
+    static constexpr int SPAN_WIDTH = 8;
+
+    float e[3];
+    float step[3];
+    float inv_area;
+    float z[3];
+    float near;
+    float far;
+    bool depth_equal = false;   // true: z == depth 通过（Z-prepass 之后的着色 pass）；false: z < depth 通过
+};
+
+// depth: 这段像素当前的深度，至少 count 个
+// z_out: 每个 lane 的插值深度（SPAN_WIDTH 个）
+// 返回值：第 i 位为 1 表示第 i 个像素在三角形内且通过深度测试
+using SpanTestKernel = uint32_t (*)(const SpanTest& span, const float* depth, int count, float* z_out);
+
+inline uint32_t span_test_scalar(const SpanTest& span, const float* depth, int count, float* z_out) {
+    uint32_t mask = 0;
+    for(int i = 0; i < count; i++) {
+        float e0 = span.e[0] + span.step[0] * (float)i;
+        float e1 = span.e[1] + span.step[1] * (float)i;
+        float e2 = span.e[2] + span.step[2] * (float)i;
+
+        float z = e0 * span.inv_area * span.z[0] + e1 * span.inv_area * span.z[1] + e2 * span.inv_area * span.z[2];
+        z_out[i] = z;
+
+        bool depth_pass = span.depth_equal ? z == depth[i] : z < depth[i];
+        if(e0 >= 0 && e1 >= 0 && e2 >= 0 && z <= span.far && z >= span.near && depth_pass) {
+            mask |= 1u << i;
+        }
+    }
+    return mask;
+}
+
+#ifdef RASTER_KERNELS_X86
+
+// 不足 SPAN_WIDTH 的尾部用 -inf 填充，保证这些 lane 的深度测试失败
+inline const float* span_padded_depth(const float* depth, int count, float* padded) {
+    if(count == SpanTest::SPAN_WIDTH) return depth;
+    for(int i = 0; i < SpanTest::SPAN_WIDTH; i++) {
+        padded[i] = i < count ? depth[i] : -INFINITY;
+    }
+    return padded;
+}
+
+inline uint32_t span_test_sse(const SpanTest& span, const float* depth, int count, float* z_out) {
+    alignas(16) float padded[SpanTest::SPAN_WIDTH];
+    depth = span_padded_depth(depth, count, padded);
+
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 inv_area = _mm_set1_ps(span.inv_area);
+    const __m128 near = _mm_set1_ps(span.near);
+    const __m128 far = _mm_set1_ps(span.far);
+
+    uint32_t mask = 0;
+    for(int half = 0; half < 2; half++) {
+        __m128 lanes = _mm_setr_ps(half * 4 + 0.0f, half * 4 + 1.0f, half * 4 + 2.0f, half * 4 + 3.0f);
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        __m128 z = zero;
+        for(int j = 0; j < 3; j++) {
+            __m128 e = _mm_add_ps(_mm_set1_ps(span.e[j]), _mm_mul_ps(_mm_set1_ps(span.step[j]), lanes));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(e, zero));
+            __m128 term = _mm_mul_ps(_mm_mul_ps(e, inv_area), _mm_set1_ps(span.z[j]));
+            z = j == 0 ? term : _mm_add_ps(z, term);
+        }
+        _mm_storeu_ps(z_out + half * 4, z);
+
+        __m128 pass = _mm_and_ps(inside, _mm_cmple_ps(z, far));
+        pass = _mm_and_ps(pass, _mm_cmpge_ps(z, near));
+        __m128 d = _mm_loadu_ps(depth + half * 4);
+        pass = _mm_and_ps(pass, span.depth_equal ? _mm_cmpeq_ps(z, d) : _mm_cmplt_ps(z, d));
+        mask |= (uint32_t)_mm_movemask_ps(pass) << (half * 4);
+    }
+    return mask & ((1u << count) - 1);
+}
+
+RASTER_TARGET_AVX2
+inline uint32_t span_test_avx2(const SpanTest& span, const float* depth, int count, float* z_out) {
+    alignas(32) float padded[SpanTest::SPAN_WIDTH];
+    depth = span_padded_depth(depth, count, padded);
+
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 inv_area = _mm256_set1_ps(span.inv_area);
+    const __m256 lanes = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+
+    __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+    __m256 z = zero;
+    for(int j = 0; j < 3; j++) {
+        __m256 e = _mm256_add_ps(_mm256_set1_ps(span.e[j]), _mm256_mul_ps(_mm256_set1_ps(span.step[j]), lanes));
+        inside = _mm256_and_ps(inside, _mm256_cmp_ps(e, zero, _CMP_GE_OQ));
+        __m256 term = _mm256_mul_ps(_mm256_mul_ps(e, inv_area), _mm256_set1_ps(span.z[j]));
+        z = j == 0 ? term : _mm256_add_ps(z, term);
+    }
+    _mm256_storeu_ps(z_out, z);
+
+    __m256 pass = _mm256_and_ps(inside, _mm256_cmp_ps(z, _mm256_set1_ps(span.far), _CMP_LE_OQ));
+    pass = _mm256_and_ps(pass, _mm256_cmp_ps(z, _mm256_set1_ps(span.near), _CMP_GE_OQ));
+    __m256 d = _mm256_loadu_ps(depth);
+    pass = _mm256_and_ps(pass, span.depth_equal ? _mm256_cmp_ps(z, d, _CMP_EQ_OQ) : _mm256_cmp_ps(z, d, _CMP_LT_OQ));
+    return (uint32_t)_mm256_movemask_ps(pass) & ((1u << count) - 1);
+}
+
+inline bool cpu_has_avx2() {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if(info[0] < 7) return false;
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    // 操作系统需要保存 YMM 寄存器
+    if(!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6) return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif
+
+inline SpanTestKernel select_span_test_kernel() {
+#ifdef RASTER_KERNELS_X86
+    if(cpu_has_avx2()) return span_test_avx2;
+    return span_test_sse; // x86-64 上 SSE2 总是可用
+#else
+    return span_test_scalar;
+#endif
+}
+
+// 运行时根据 CPUID 选一次，之后直接调用
+inline SpanTestKernel span_test_kernel() {
+    static const SpanTestKernel kernel = select_span_test_kernel();
+    return kernel;
+}
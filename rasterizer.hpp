@@ -4,10 +4,19 @@
 #include "matrix.hpp"
 #include "common_header.hpp"
 #include "transforms.hpp"
+#include "thread_pool.hpp"
+#include "raster_kernels.hpp"
+#include "framebuffer.hpp"
+#include "clipping.hpp"
+#include "transform_kernels.hpp"
 #include <vector>
 #include <iostream>
 #include <cmath>
-#include <list>
+#include <memory>
+#include <functional>
+#include <algorithm>
+#include <bit>
+#include <span>
 
 template <typename T> 
 T min3(const T& t1, const T& t2, const T& t3) {
@@ -19,130 +28,369 @@ T max3(const T& t1, const T& t2, const T& t3) {
     return std::max(std::max(t1, t2), t3);
 }
 
-class ObjectDescriptor {
-public:
-    std::shared_ptr<AbstractObject> object;
-    Mat3 dir; // 3 x 3, [inWorld(objX) inWorld(objY) inWorld(objZ)]
-    Vec3 pos; // 3 x 1
+// 屏幕上逆时针（x 向右、y 向上）的三角形是正面
+enum class CullMode {
+    None,
+    Back,
+    Front,
 };
 
-bool to_left(const Vec2& a, const Vec2& b) {
-    return a[0] * b[1] - b[0] * a[1] > 0;
+float deg_to_rad(float deg) {
+    return deg / 180 * acos(-1.0);
 }
 
-bool in_triangle(const Vec2& pt, const Vec2& v1, const Vec2& v2, const Vec2& v3) {
-    auto e1 = v1 - v2;
-    auto p1 = pt - v2;
+// 屏幕空间的三角形。x_min 等已经裁剪到屏幕范围内，左闭右开。
+// 被裁剪过的三角形，pos_world / pos_screen 是裁剪后子三角形的顶点，vertices 仍是原三角形的顶点
+// （物体内的顶点下标），bary[j] 是子三角形第 j 个顶点关于原三角形的权重。
+struct TriangleSetup {
+    uint32_t object;
+    int vertices[3];
+    Vec4 pos_world[3];
+    Vec4 pos_screen[3];
+    bool clipped;
+    float bary[3][3];
+    int x_min, x_max;
+    int y_min, y_max;
+
+    // 像素坐标（像素中心为整数）下的边函数 e_i(x, y) = edge_a[i] * (x - x_min) + edge_b[i] * (y - y_min) + edge_c[i]，
+    // e_i 对应顶点 i 对面的边。已按绕序调整符号，三角形内部三者均 >= 0，且 e_i * inv_area 就是重心坐标。
+    // 以包围盒左下角为原点，否则 edge_c 是两个很大的数相减，小三角形会丢精度。
+    float edge_a[3], edge_b[3], edge_c[3];
+    float inv_area;
+    float z[3];
+    float z_min;
+    float inv_w[3];
+
+    float edge(int i, int x, int y) const {
+        return edge_a[i] * (x - x_min) + edge_b[i] * (y - y_min) + edge_c[i];
+    }
 
-    auto e2 = v2 - v3;
-    auto p2 = pt - v3;
+    // 像素中心在 [x0, x1) x [y0, y1) 内的矩形是否可能和三角形相交。只要有一条边使四个角都在外侧就不相交。
+    bool overlaps(int x0, int y0, int x1, int y1) const {
+        for(int i = 0; i < 3; i++) {
+            int x = edge_a[i] > 0 ? x1 - 1 : x0;
+            int y = edge_b[i] > 0 ? y1 - 1 : y0;
+            if(edge(i, x, y) < 0) return false;
+        }
+        return true;
+    }
 
-    auto e3 = v3 - v1;
-    auto p3 = pt - v1;
+    // px, py 是相对于 (x_min, y_min) 的坐标。返回 false 表示三角形退化或被剔除
+    bool setup_edges(const float px[3], const float py[3], CullMode cull_mode) {
+        for(int i = 0; i < 3; i++) {
+            int j = (i + 1) % 3, k = (i + 2) % 3;
+            edge_a[i] = py[j] - py[k];
+            edge_b[i] = px[k] - px[j];
+            edge_c[i] = px[j] * py[k] - py[j] * px[k];
+        }
+        float area = edge_a[0] * px[0] + edge_b[0] * py[0] + edge_c[0];
+        if(area == 0 || !std::isfinite(area)) return false;
+        if(cull_mode == CullMode::Back && area < 0) return false;
+        if(cull_mode == CullMode::Front && area > 0) return false;
+        if(area < 0) {
+            for(int i = 0; i < 3; i++) {
+                edge_a[i] = -edge_a[i];
+                edge_b[i] = -edge_b[i];
+                edge_c[i] = -edge_c[i];
+            }
+            area = -area;
+        }
+        inv_area = 1 / area;
+        return true;
+    }
 
-    auto r1 = to_left(e1, p1);
-    auto r2 = to_left(e2, p2);
-    auto r3 = to_left(e3, p3);
+    // 像素 (x, y) 处的屏幕空间重心坐标，不要求在三角形内
+    VisibilitySample sample_at(uint32_t index, int x, int y) const {
+        return VisibilitySample{ index, edge(1, x, y) * inv_area, edge(2, x, y) * inv_area };
+    }
 
-    return r1 == r2 && r2 == r3;
-}
+    // 可见性缓冲中的屏幕空间重心坐标 -> 原三角形上透视校正后的权重 (1 - k2 - k3, k2, k3) 和世界坐标
+    void resolve(const VisibilitySample& sample, float& k2, float& k3, Vec3& world) const {
+        auto nk1 = (1 - sample.k2 - sample.k3) * inv_w[0];
+        auto nk2 = sample.k2 * inv_w[1];
+        auto nk3 = sample.k3 * inv_w[2];
+        auto nksum = nk1 + nk2 + nk3;
+        nk1 /= nksum;
+        nk2 /= nksum;
+        nk3 /= nksum;
+
+        k2 = nk2;
+        k3 = nk3;
+        if(clipped) {
+            k2 = nk1 * bary[0][1] + nk2 * bary[1][1] + nk3 * bary[2][1];
+            k3 = nk1 * bary[0][2] + nk2 * bary[1][2] + nk3 * bary[2][2];
+        }
 
-std::tuple<float, float, float> bary_centric(
-    const Vec3& center, 
-    const Vec3& v1, 
-    const Vec3& v2, 
-    const Vec3& v3
-    ) {
-    auto area1 = cross_product(center - v2, center - v3).norm2();
-    auto area2 = cross_product(center - v3, center - v1).norm2();
-    auto area3 = cross_product(center - v1, center - v2).norm2();
+        world = to_vec3_as_pos(pos_world[0]) * nk1 + 
+                to_vec3_as_pos(pos_world[1]) * nk2 + 
+                to_vec3_as_pos(pos_world[2]) * nk3 ;
+    }
+};
 
-    auto area_sum = area1 + area2 + area3;
-    float k1 = area1 / area_sum;
-    float k2 = area2 / area_sum;
-    float k3 = area3 / area_sum;
+// 每个物体只做一次类型擦除：Rasterizer 按物体（resolve 时按一段同一物体的像素）调用虚函数，
+// 里面的顶点、像素循环都是具体类型。着色器用限定名调用，可以内联，不经过 std::any 和 dynamic_cast。
+template <typename Uniform>
+class AbstractDrawCall {
+public:
+    virtual ~AbstractDrawCall() {}
+    virtual std::unique_ptr<AbstractDrawCall> clone() const = 0;
+    virtual const std::vector<std::tuple<int, int, int>>& triangles() const = 0;
+
+    virtual size_t vertex_count() const = 0;
+    // 每帧在调用线程上调用一次，为这一帧的顶点分配空间。之后 shade_vertices 可以在多个线程上处理互不相交的区间
+    virtual void begin_frame() = 0;
+    // 着色第 [begin, end) 个顶点，模型空间坐标写到 pos_model[i]
+    virtual void shade_vertices(const Uniform& uniform, const RasterizerInfo& info, size_t begin, size_t end, Vec3* pos_model) = 0;
+    // 左下角在 (x, y) 的像素块，samples / out 按 lane 排列（PACKET_LANES 个），只处理 mask 中属于这个物体的 lane
+    virtual void shade_fragments(
+        const TriangleSetup* triangles, const VisibilitySample* samples, uint32_t mask, int x, int y,
+        const Uniform& uniform, RGBAColor* out
+    ) const = 0;
+    // 帧末释放着色过的顶点
+    virtual void end_frame() = 0;
+};
 
-    return {k1, k2, k3};
-}
+template <typename Uniform, typename A, typename P, typename VShaderT, typename FShaderT>
+class DrawCall: public AbstractDrawCall<Uniform> {
+    using ObjectT = Object<A, P, Uniform, VShaderT, FShaderT>;
 
-template <typename T> 
-std::vector<std::vector<T>> matrix_of_size(int n_rows, int n_cols, const T& default_value) {
-    return std::vector<std::vector<T>>(n_rows, std::vector<T>(n_cols, default_value));
-}
+    std::shared_ptr<const ObjectT> object;     // 拷贝 Rasterizer 时共享
+    std::vector<Vertex<P>> vertices;            // 这一帧着色过的顶点
+    std::vector<float> varyings;                // 声明了 VaryingLayout 时，每个顶点的 varying 连续存放
 
-float deg_to_rad(float deg) {
-    return deg / 180 * acos(-1.0);
-}
+public:
+    DrawCall(std::shared_ptr<const ObjectT> object): object(std::move(object)) {}
 
+    virtual std::unique_ptr<AbstractDrawCall<Uniform>> clone() const override {
+        return std::make_unique<DrawCall>(object);
+    }
 
-// Object<Uniform, Attribute, Property, Shader>
-// VertexData<Attribute> --- VertexShader<Attribute, Uniform> --> Vertex<Property> --- 
-// --- Fragment<Vertex> --> RGBAColor
+    virtual const std::vector<std::tuple<int, int, int>>& triangles() const override {
+        return object->triangles;
+    }
 
-template<typename Uniform>
-class Rasterizer {
-    static constexpr int POOL_SIZE = 1024 * 1024 * 4; // 4MB per pool
-    std::list<void*> fragment_pools;    // 这里，没有重复利用！
-    decltype(fragment_pools.begin()) pool_it = fragment_pools.begin(); // TODO: 顺序
-    size_t mem_index = 0;
-
-    void reset_mem() {
-        pool_it = fragment_pools.begin();
-        mem_index = 0;
+    virtual size_t vertex_count() const override {
+        return object->vertices.size();
     }
 
-    void* alloc_mem(size_t size) {
-        if(size > POOL_SIZE) {
-            throw "fragment size is too large.";
+    virtual void begin_frame() override {
+        vertices.resize(object->vertices.size());
+        if constexpr (VaryingLayout<P>::declared) {
+            varyings.resize(vertices.size() * VaryingLayout<P>::SIZE);
         }
+    }
 
-        if(pool_it != fragment_pools.end() && mem_index + size > POOL_SIZE) {
-            pool_it++;
-            mem_index = 0;
+    virtual void shade_vertices(const Uniform& uniform, const RasterizerInfo& info, size_t begin, size_t end, Vec3* pos_model) override {
+        for(size_t i = begin; i < end; i++) {
+            vertices[i] = object->vshader.VShaderT::shade(object->vertices[i], uniform, info);
+            pos_model[i] = vertices[i].pos_model;
+            if constexpr (VaryingLayout<P>::declared) {
+                constexpr int SIZE = VaryingLayout<P>::SIZE;
+                VaryingLayout<P>::gather(vertices[i].properties, &varyings[i * SIZE]);
+            }
         }
-        
-        // 如果当前有 pool，那么空间一定足够
-        
-        if(pool_it == fragment_pools.end()) {
-            std::cerr << "pool: malloc" << std::endl;
-            pool_it = fragment_pools.insert(pool_it, malloc(POOL_SIZE));
-            mem_index = 0;
+    }
+
+    // 先求每个像素的权重，再把所有像素的 varying（和导数）一起插值，最后整个 packet 一起着色
+    virtual void shade_fragments(
+        const TriangleSetup* triangles, const VisibilitySample* samples, uint32_t mask, int x, int y,
+        const Uniform& uniform, RGBAColor* out
+    ) const override {
+        constexpr int LANES = PACKET_LANES;
+
+        const TriangleSetup* tris[LANES] = {};
+        float k[3][LANES] = {};
+        Vec3 pos_world[LANES];
+        for(uint32_t m = mask; m; m &= m - 1) {
+            int i = std::countr_zero(m);
+            tris[i] = &triangles[samples[i].triangle];
+            tris[i]->resolve(samples[i], k[1][i], k[2][i], pos_world[i]);
+            k[0][i] = 1 - k[1][i] - k[2][i];
+        }
+
+        if constexpr (VaryingLayout<P>::declared) {
+            constexpr int SIZE = VaryingLayout<P>::SIZE;
+            static const float zeros[SIZE] = {};
+
+            FragmentPacket<P> packet {};
+            packet.mask = mask;
+
+            // 权重为 w 时所有 lane 的 varying，不在 mask 里的 lane 得到 0
+            auto interpolate = [&](const float (&w)[3][LANES], float* out) {
+                const float* corners[3][LANES];
+                for(int i = 0; i < LANES; i++) {
+                    for(int t = 0; t < 3; t++) {
+                        corners[t][i] = tris[i] ? &varyings[tris[i]->vertices[t] * SIZE] : zeros;
+                    }
+                }
+                interpolate_varyings<SIZE, LANES>(corners, w, LANES, out);
+            };
+
+            for(uint32_t m = mask; m; m &= m - 1) {
+                int i = std::countr_zero(m);
+                for(int c = 0; c < 3; c++) {
+                    packet.pos_world[c][i] = pos_world[i][c];
+                }
+                packet.flat[i] = &vertices[tris[i]->vertices[0]].properties;
+            }
+            interpolate(k, &packet.varyings[0][0]);
+
+            // 导数：同一个三角形在 (x + 1, y) 和 (x, y + 1) 处的值减去本像素的值
+            float kx[3][LANES] = {}, ky[3][LANES] = {};
+            for(uint32_t m = mask; m; m &= m - 1) {
+                int i = std::countr_zero(m);
+                int px = x + i % PACKET_WIDTH, py = y + i / PACKET_WIDTH;
+                Vec3 unused;
+                tris[i]->resolve(tris[i]->sample_at(samples[i].triangle, px + 1, py), kx[1][i], kx[2][i], unused);
+                tris[i]->resolve(tris[i]->sample_at(samples[i].triangle, px, py + 1), ky[1][i], ky[2][i], unused);
+                kx[0][i] = 1 - kx[1][i] - kx[2][i];
+                ky[0][i] = 1 - ky[1][i] - ky[2][i];
+            }
+            interpolate(kx, &packet.ddx[0][0]);
+            interpolate(ky, &packet.ddy[0][0]);
+            for(int j = 0; j < SIZE; j++) {
+                for(int i = 0; i < LANES; i++) {
+                    packet.ddx[j][i] -= packet.varyings[j][i];
+                    packet.ddy[j][i] -= packet.varyings[j][i];
+                }
+            }
+
+            // FShaderT 自己实现了 shade_batch 才按 packet 调用，否则逐个像素静态调用 shade
+            using Base = FShader<P, Uniform>;
+            if constexpr (!std::is_same_v<decltype(&FShaderT::shade_batch), decltype(&Base::shade_batch)>) {
+                object->fshader.FShaderT::shade_batch(packet, uniform, out);
+            } else {
+                for(uint32_t m = mask; m; m &= m - 1) {
+                    int i = std::countr_zero(m);
+                    out[i] = object->fshader.FShaderT::shade(packet.fragment(i), uniform);
+                }
+            }
+        } else {
+            for(uint32_t m = mask; m; m &= m - 1) {
+                int i = std::countr_zero(m);
+                auto& p1 = vertices[tris[i]->vertices[0]].properties;
+                auto& p2 = vertices[tris[i]->vertices[1]].properties;
+                auto& p3 = vertices[tris[i]->vertices[2]].properties;
+                Fragment<P> fragment(interpolate_properties(p1, k[0][i], p2, k[1][i], p3, k[2][i]));
+                fragment.pos_world = pos_world[i];
+                out[i] = object->fshader.FShaderT::shade(fragment, uniform);
+            }
         }
-        
-        // 那么当前一定有 pool
+    }
 
-        void* out = (void*)((char*)*pool_it + mem_index);
-        mem_index += size;
-        return out;
+    virtual void end_frame() override {
+        vertices.clear();
     }
+};
+
+template <typename Uniform>
+class ObjectDescriptor {
+public:
+    std::unique_ptr<AbstractDrawCall<Uniform>> draw;
+    Mat3 dir; // 3 x 3, [inWorld(objX) inWorld(objY) inWorld(objZ)]
+    Vec3 pos; // 3 x 1
+    CullMode cull_mode = CullMode::None;
+
+    ObjectDescriptor(std::unique_ptr<AbstractDrawCall<Uniform>> draw, const Mat3& dir, const Vec3& pos, CullMode cull_mode):
+        draw(std::move(draw)), dir(dir), pos(pos), cull_mode(cull_mode) {}
+    ObjectDescriptor(const ObjectDescriptor& other):
+        draw(other.draw->clone()), dir(other.dir), pos(other.pos), cull_mode(other.cull_mode) {}
+    ObjectDescriptor(ObjectDescriptor&&) = default;
+    ObjectDescriptor& operator=(const ObjectDescriptor& other) {
+        return *this = ObjectDescriptor(other);
+    }
+    ObjectDescriptor& operator=(ObjectDescriptor&&) = default;
+};
 
-    std::vector<ObjectDescriptor> objects;
+
+// Object<Uniform, Attribute, Property, Shader>
+// VertexData<Attribute> --- VertexShader<Attribute, Uniform> --> Vertex<Property> --- 
+// --- Fragment<Vertex> --> RGBAColor
+//
+// sort-middle：setup 阶段完成顶点着色并把三角形分到 TILE_SIZE x TILE_SIZE 的 tile 里（按顶点、三角形的区间分块并行），
+// 之后每个 tile 由一个 worker 独立完成光栅化和着色。tile 内按提交顺序处理三角形，结果与单线程一致。
+
+template<typename Uniform>
+class Rasterizer {
+    static constexpr int TILE_SIZE = FrameBuffer::TILE_SIZE;
+
+    enum class RasterPass {
+        DepthAndVisibility,         // 一遍完成：z < depth 时同时写深度和可见性
+        DepthOnly,                  // Z-prepass：只写深度
+        VisibilityOnEqualDepth,     // prepass 之后：只在 z == depth 处写可见性
+    };
+
+    FrameBuffer framebuffer;                        // 跨帧复用，每帧只 clear
+    // 这一帧着色过的顶点（所有物体依次拼接）
+    std::vector<Vec3> vertex_model;
+    std::vector<Vec4> vertex_world;
+    std::vector<Vec4> vertex_clip;
+    std::vector<uint32_t> vertex_outcode;
+    std::vector<TriangleSetup> triangles;
+    std::vector<std::vector<int>> bins;             // tile -> triangles 的下标，保持提交顺序
+    std::unique_ptr<ThreadPool> thread_pool;
+
+    // setup 阶段也在线程池上做。顶点按物体内的区间分块；三角形按物体内的区间分块，
+    // 每块有自己的三角形和 tile 列表，最后按提交顺序拼接，结果与串行 setup 逐位相同
+    struct ObjectFrame {
+        RasterizerInfo info;                        // info.M 是这个物体的模型变换
+        Mat4 MVP;
+        size_t base;                                // 第一个顶点在 vertex_* 中的下标
+    };
+    struct VertexChunk {
+        uint32_t object;
+        size_t begin, end;                          // 物体内顶点的区间
+    };
+    struct SetupChunk {
+        uint32_t object;
+        size_t begin, end;                          // 物体内三角形的区间
+        size_t offset;                              // 第一个三角形在 triangles 中的下标
+        std::vector<TriangleSetup> triangles;
+        std::vector<std::vector<int>> bins;         // tile -> 块内三角形的下标
+    };
+    static constexpr size_t MIN_VERTEX_CHUNK = 1024;
+    static constexpr size_t MIN_SETUP_CHUNK = 512;
+    static constexpr int CHUNKS_PER_WORKER = 4;
+    std::vector<ObjectFrame> object_frames;
+    std::vector<VertexChunk> vertex_chunks;
+    std::vector<SetupChunk> setup_chunks;           // 跨帧复用，保留各自的容量
+
+    // 每帧开始时从 uniform 拷贝一次，之后整帧只读，所有 worker 共享。
+    // 单独对齐到 cache line，不和 setup 阶段会写的成员挤在一起。
+    struct alignas(64) UniformSnapshot {
+        Uniform value;
+    };
+    UniformSnapshot frame_uniform;
+
+    std::vector<ObjectDescriptor<Uniform>> objects;
 
 public:
     Uniform uniform;
+    int n_threads = 0; // 0: std::thread::hardware_concurrency()
+    // 先只填深度，再只在最终可见的像素上计算重心坐标、写可见性。overdraw 高、提交顺序靠后的遮挡物多时有用。
+    bool depth_prepass = false;
 
     Rasterizer() = default;
-    Rasterizer(const Rasterizer& r): objects(r.objects), uniform(r.uniform) {}
-    Rasterizer(Rasterizer&& r): objects(std::move(r.objects)), uniform(std::move(r.uniform)) {}
+    Rasterizer(const Rasterizer& r): objects(r.objects), uniform(r.uniform), n_threads(r.n_threads), depth_prepass(r.depth_prepass) {}
+    Rasterizer(Rasterizer&& r): objects(std::move(r.objects)), uniform(std::move(r.uniform)), n_threads(r.n_threads), depth_prepass(r.depth_prepass) {}
     Rasterizer& operator=(const Rasterizer& r) {
         objects = r.objects;
         uniform = r.uniform;
+        n_threads = r.n_threads;
+        depth_prepass = r.depth_prepass;
         return *this;
     }
-    ~Rasterizer() {
-        for(auto ptr: fragment_pools) {
-            free(ptr);
-            ptr = nullptr;
-        }
-    }
 
     template<typename T, typename P, typename VShaderT, typename FShaderT>
     Rasterizer& addObject(
         const Object<T, P, Uniform, VShaderT, FShaderT>& obj, 
         const Mat3& dir, 
-        const Vec3& pos
+        const Vec3& pos,
+        CullMode cull_mode = CullMode::None // 只对封闭的网格开启
     ) {
-        objects.push_back(ObjectDescriptor{std::make_shared<Object<T, P, Uniform, VShaderT, FShaderT>>(obj), dir, pos});
+        using ObjectT = Object<T, P, Uniform, VShaderT, FShaderT>;
+        auto draw = std::make_unique<DrawCall<Uniform, T, P, VShaderT, FShaderT>>(std::make_shared<const ObjectT>(obj));
+        objects.emplace_back(std::move(draw), dir, pos, cull_mode);
         return *this;
     }
 
@@ -177,8 +425,7 @@ public:
         auto P = projection_transform(near, far);
         auto SPV = S * P * V;
 
-        auto f_buffer = matrix_of_size<std::pair<const AbstractFragment*, const AbstractFShader*>>(width, height, std::make_pair(nullptr, nullptr));
-        auto d_buffer = matrix_of_size<float>(width, height, far + 1); // TODO: -inf
+        framebuffer.resize(width, height);
 
         RasterizerInfo info;
         info.V = V;
@@ -187,122 +434,365 @@ public:
         info.camera_top = camera_top;
         info.camera_pos = camera_pos;
 
-        for(auto desp: objects) {
-            auto& pObj = desp.object;
-            auto& vShader = pObj->getVShader();
-            auto& fShader = pObj->getFShader();
-
-            auto M = model_transform(desp.pos, desp.dir);
-            info.M = M;
-
-            for(auto [i1, i2, i3]: pObj->triangles) {
-                const int VertexSize = pObj->getVShader().vertexSize();
-                char* mem = (char*) alloc_mem (VertexSize * 3);
-                auto& v1 = vShader.shade(pObj->getVertexData(i1), uniform, info, mem + 0 * VertexSize);
-                auto& v2 = vShader.shade(pObj->getVertexData(i2), uniform, info, mem + 1 * VertexSize);
-                auto& v3 = vShader.shade(pObj->getVertexData(i3), uniform, info, mem + 2 * VertexSize);
-
-                auto pos1_world_vec4 = M * to_vec4_as_pos(v1.pos_model);
-                auto pos2_world_vec4 = M * to_vec4_as_pos(v2.pos_model);
-                auto pos3_world_vec4 = M * to_vec4_as_pos(v3.pos_model);
-
-                auto pos1_screen_vec4 = SPV * pos1_world_vec4;
-                auto pos2_screen_vec4 = SPV * pos2_world_vec4;
-                auto pos3_screen_vec4 = SPV * pos3_world_vec4;
-
-                auto pos1_screen_vec3 = to_vec3_as_pos(pos1_screen_vec4);
-                auto pos2_screen_vec3 = to_vec3_as_pos(pos2_screen_vec4);
-                auto pos3_screen_vec3 = to_vec3_as_pos(pos3_screen_vec4);
-
-                float fragment_width = 2.0 / width;
-                float fragment_height = 2.0 / height;
-
-                int x_min = (min3(pos1_screen_vec3[0], pos2_screen_vec3[0], pos3_screen_vec3[0]) + 1) / fragment_width - 0.5 - 1;
-                int x_max = (max3(pos1_screen_vec3[0], pos2_screen_vec3[0], pos3_screen_vec3[0]) + 1) / fragment_width - 0.5 + 2;
-
-                int y_min = (min3(pos1_screen_vec3[1], pos2_screen_vec3[1], pos3_screen_vec3[1]) + 1) / fragment_height - 0.5 - 1;
-                int y_max = (max3(pos1_screen_vec3[1], pos2_screen_vec3[1], pos3_screen_vec3[1]) + 1) / fragment_height - 0.5 + 2;
-                
-                for(int x_index = std::max(0, x_min); x_index < std::min(width, x_max); x_index++) {
-                    for(int y_index = std::max(0, y_min); y_index < std::min(height, y_max); y_index++) {
-                        float x = x_index * fragment_width + 0.5 * fragment_width - 1;
-                        float y = y_index * fragment_height + 0.5 * fragment_height - 1;
-                        Vec2 pt {x, y};
-
-                        Vec2 pos1_screen_vec2 = { pos1_screen_vec3[0], pos1_screen_vec3[1] }; 
-                        Vec2 pos2_screen_vec2 = { pos2_screen_vec3[0], pos2_screen_vec3[1] }; 
-                        Vec2 pos3_screen_vec2 = { pos3_screen_vec3[0], pos3_screen_vec3[1] }; 
-
-                        if(in_triangle(pt, pos1_screen_vec2, pos2_screen_vec2, pos3_screen_vec2)) {
-                            Vec3 center {x, y, 0};
-
-                            // 如果我不强制令z=0呢？那就会四点不共面
-                            auto [k1, k2, k3] = bary_centric(
-                                center, 
-                                { pos1_screen_vec2[0], pos1_screen_vec2[1], 0 }, 
-                                { pos2_screen_vec2[0], pos2_screen_vec2[1], 0 }, 
-                                { pos3_screen_vec2[0], pos3_screen_vec2[1], 0 }
-                            );
-
-                            float z1 = pos1_screen_vec3[2];
-                            float z2 = pos2_screen_vec3[2];
-                            float z3 = pos3_screen_vec3[2];
-
-                            float z = k1 * z1 + k2 * z2 + k3 * z3;;
-                            
-                            if(z <= far && z >= near && z < d_buffer[x_index][y_index]) {
-                                d_buffer[x_index][y_index] = z;
-
-                                auto mem = alloc_mem(v1.fragment_size());
-                                
-                                auto nk1 = k1 / pos1_screen_vec4[3];
-                                auto nk2 = k2 / pos2_screen_vec4[3];
-                                auto nk3 = k3 / pos3_screen_vec4[3];
-                                auto nksum = nk1 + nk2 + nk3;
-                                nk1 /= nksum;
-                                nk2 /= nksum;
-                                nk3 /= nksum;
-
-                                auto& fragment = v1.linear_interpolation(
-                                    nk2, v2,
-                                    nk3, v3,
-                                    mem
-                                );
-
-                                fragment.pos_world =  to_vec3_as_pos(pos1_world_vec4) * nk1 + 
-                                                      to_vec3_as_pos(pos2_world_vec4) * nk2 + 
-                                                      to_vec3_as_pos(pos3_world_vec4) * nk3 ;
-
-                                if (f_buffer[x_index][y_index].first) {
-                                    f_buffer[x_index][y_index].first->~AbstractFragment();
+        float fragment_width = 2.0 / width;
+        float fragment_height = 2.0 / height;
+
+        int n_tiles_x = framebuffer.n_tiles_x();
+
+        triangles.clear();
+        bins.resize(framebuffer.n_tiles());
+
+        int n_workers = n_threads > 0 ? n_threads : std::max(1u, std::thread::hardware_concurrency());
+        if(!thread_pool || thread_pool->size() != n_workers) {
+            thread_pool = std::make_unique<ThreadPool>(n_workers);
+        }
+
+        ClipVolume clip_volume { near, far };
+
+        frame_uniform.value = uniform;
+
+        // 一个（可能是裁剪出来的）三角形：变换到像素坐标、建立边函数、剔除、分 tile
+        auto setup_triangle = [&](
+            SetupChunk& chunk, const ClipVertex& c1, const ClipVertex& c2, const ClipVertex& c3, bool clipped,
+            uint32_t object, const int vertices[3], CullMode cull_mode
+        ) {
+            const ClipVertex* corners[3] = { &c1, &c2, &c3 };
+
+            TriangleSetup tri;
+            tri.object = object;
+            tri.clipped = clipped;
+
+            float px[3], py[3];
+            for(int i = 0; i < 3; i++) {
+                tri.vertices[i] = vertices[i];
+                tri.pos_world[i] = corners[i]->world;
+                tri.pos_screen[i] = corners[i]->clip;
+                for(int j = 0; j < 3; j++) {
+                    tri.bary[i][j] = corners[i]->bary[j];
+                }
+
+                auto pos_screen_vec3 = to_vec3_as_pos(tri.pos_screen[i]);
+                px[i] = (pos_screen_vec3[0] + 1) / fragment_width - 0.5f;
+                py[i] = (pos_screen_vec3[1] + 1) / fragment_height - 0.5f;
+                tri.z[i] = pos_screen_vec3[2];
+                tri.inv_w[i] = 1 / tri.pos_screen[i][3];
+            }
+            tri.z_min = min3(tri.z[0], tri.z[1], tri.z[2]);
+
+            // guard band 之内的坐标不会太大，clamp 到屏幕即可
+            tri.x_min = (int)std::clamp(std::floor(min3(px[0], px[1], px[2])), 0.0f, (float)width);
+            tri.x_max = (int)std::clamp(std::floor(max3(px[0], px[1], px[2])) + 1, 0.0f, (float)width);
+            tri.y_min = (int)std::clamp(std::floor(min3(py[0], py[1], py[2])), 0.0f, (float)height);
+            tri.y_max = (int)std::clamp(std::floor(max3(py[0], py[1], py[2])) + 1, 0.0f, (float)height);
+
+            for(int i = 0; i < 3; i++) {
+                px[i] -= tri.x_min;
+                py[i] -= tri.y_min;
+            }
+
+            if(tri.x_min >= tri.x_max || tri.y_min >= tri.y_max || !tri.setup_edges(px, py, cull_mode)) {
+                return;
+            }
+
+            int index = chunk.triangles.size();
+            chunk.triangles.push_back(tri);
+
+            // 只分到和三角形真正相交的 tile，大三角形的代价与可见面积成正比
+            for(int ty = tri.y_min / TILE_SIZE; ty <= (tri.y_max - 1) / TILE_SIZE; ty++) {
+                for(int tx = tri.x_min / TILE_SIZE; tx <= (tri.x_max - 1) / TILE_SIZE; tx++) {
+                    int x0 = tx * TILE_SIZE, y0 = ty * TILE_SIZE;
+                    if(tri.overlaps(x0, y0, std::min(width, x0 + TILE_SIZE), std::min(height, y0 + TILE_SIZE))) {
+                        chunk.bins[ty * n_tiles_x + tx].push_back(index);
+                    }
+                }
+            }
+        };
+
+        // setup: 顶点着色、变换到裁剪空间、裁剪、分 tile
+        object_frames.resize(objects.size());
+        size_t n_vertices = 0, n_object_triangles = 0;
+        for(uint32_t object = 0; object < objects.size(); object++) {
+            auto& desp = objects[object];
+            auto& frame = object_frames[object];
+            frame.info = info;
+            frame.info.M = model_transform(desp.pos, desp.dir);
+            frame.MVP = SPV * frame.info.M;
+            frame.base = n_vertices;
+            n_vertices += desp.draw->vertex_count();
+            n_object_triangles += desp.draw->triangles().size();
+            desp.draw->begin_frame();
+        }
+        vertex_model.resize(n_vertices);
+        vertex_world.resize(n_vertices);
+        vertex_clip.resize(n_vertices);
+        vertex_outcode.resize(n_vertices);
+
+        // 块的大小只影响并行度，不影响结果
+        auto chunk_size = [&](size_t total, size_t min_size) {
+            return std::max(min_size, total / ((size_t)n_workers * CHUNKS_PER_WORKER) + 1);
+        };
+
+        // 顶点阶段：每个顶点只着色、变换一次，三角形只引用结果。
+        // 世界坐标和裁剪坐标都直接从模型坐标批量变换，不再串行地乘两次
+        vertex_chunks.clear();
+        size_t vertex_chunk = chunk_size(n_vertices, MIN_VERTEX_CHUNK);
+        for(uint32_t object = 0; object < objects.size(); object++) {
+            size_t count = objects[object].draw->vertex_count();
+            for(size_t begin = 0; begin < count; begin += vertex_chunk) {
+                vertex_chunks.push_back(VertexChunk{ object, begin, std::min(count, begin + vertex_chunk) });
+            }
+        }
+
+        thread_pool->run((int)vertex_chunks.size(), [&](int task) {
+            auto [object, begin, end] = vertex_chunks[task];
+            auto& frame = object_frames[object];
+            objects[object].draw->shade_vertices(frame_uniform.value, frame.info, begin, end, vertex_model.data() + frame.base);
+
+            size_t first = frame.base + begin, count = end - begin;
+            std::span<const Vec3> positions(vertex_model.data() + first, count);
+            transform_points(frame.info.M, positions, { vertex_world.data() + first, count });
+            transform_points(frame.MVP, positions, { vertex_clip.data() + first, count }, clip_volume, { vertex_outcode.data() + first, count });
+        });
+
+        // 三角形阶段：每块按顺序裁剪、setup，写到自己的三角形和 tile 列表里
+        size_t n_setup_chunks = 0;
+        size_t setup_chunk = chunk_size(n_object_triangles, MIN_SETUP_CHUNK);
+        for(uint32_t object = 0; object < objects.size(); object++) {
+            size_t count = objects[object].draw->triangles().size();
+            for(size_t begin = 0; begin < count; begin += setup_chunk) {
+                if(n_setup_chunks == setup_chunks.size()) setup_chunks.emplace_back();
+                auto& chunk = setup_chunks[n_setup_chunks++];
+                chunk.object = object;
+                chunk.begin = begin;
+                chunk.end = std::min(count, begin + setup_chunk);
+            }
+        }
+
+        thread_pool->run((int)n_setup_chunks, [&](int task) {
+            auto& chunk = setup_chunks[task];
+            chunk.triangles.clear();
+            chunk.bins.resize(framebuffer.n_tiles());
+            for(auto& bin: chunk.bins) bin.clear();
+
+            auto& desp = objects[chunk.object];
+            auto& object_triangles = desp.draw->triangles();
+            size_t base = object_frames[chunk.object].base;
+
+            for(size_t t = chunk.begin; t < chunk.end; t++) {
+                auto [i1, i2, i3] = object_triangles[t];
+                int vertices[3] = { i1, i2, i3 };
+                size_t indices[3] = { base + i1, base + i2, base + i3 };
+
+                // 三个顶点都在同一个平面外侧
+                uint32_t outcode_and = vertex_outcode[indices[0]] & vertex_outcode[indices[1]] & vertex_outcode[indices[2]];
+                uint32_t outcode_or = vertex_outcode[indices[0]] | vertex_outcode[indices[1]] | vertex_outcode[indices[2]];
+                if(outcode_and) continue;
+
+                ClipVertex poly[ClipVolume::MAX_VERTICES];
+                for(int i = 0; i < 3; i++) {
+                    poly[i].world = vertex_world[indices[i]];
+                    poly[i].clip = vertex_clip[indices[i]];
+                    for(int j = 0; j < 3; j++) {
+                        poly[i].bary[j] = i == j ? 1 : 0;
+                    }
+                }
+
+                int n = 3;
+                if(outcode_or) {
+                    n = clip_volume.clip_polygon(poly, n, outcode_or);
+                }
+
+                for(int i = 1; i + 1 < n; i++) {
+                    setup_triangle(chunk, poly[0], poly[i], poly[i + 1], outcode_or != 0, chunk.object, vertices, desp.cull_mode);
+                }
+            }
+        });
+
+        // 按提交顺序拼接各块的三角形；tile 列表在 process_tile 里拼接
+        size_t n_triangles = 0;
+        for(size_t c = 0; c < n_setup_chunks; c++) {
+            setup_chunks[c].offset = n_triangles;
+            n_triangles += setup_chunks[c].triangles.size();
+        }
+        triangles.resize(n_triangles);
+        thread_pool->run((int)n_setup_chunks, [&](int task) {
+            auto& chunk = setup_chunks[task];
+            std::copy(chunk.triangles.begin(), chunk.triangles.end(), triangles.begin() + chunk.offset);
+        });
+
+        // 每个 tile 只读写 framebuffer 中自己的那一段，不需要加锁
+        std::function<void(int)> process_tile = [&](int tile) {
+            auto span_test = span_test_kernel();
+            int tile_x0 = (tile % n_tiles_x) * TILE_SIZE;
+            int tile_y0 = (tile / n_tiles_x) * TILE_SIZE;
+            int tile_x1 = std::min(width, tile_x0 + TILE_SIZE);
+            int tile_y1 = std::min(height, tile_y0 + TILE_SIZE);
+
+            framebuffer.clear_tile(tile, far + 1); // TODO: -inf
+
+            auto& bin = bins[tile];
+            bin.clear();
+            for(size_t c = 0; c < n_setup_chunks; c++) {
+                auto& chunk = setup_chunks[c];
+                for(int local: chunk.bins[tile]) {
+                    bin.push_back((int)(chunk.offset + local));
+                }
+            }
+
+            constexpr int BLOCK_SIZE = FrameBuffer::BLOCK_SIZE;
+            static_assert(BLOCK_SIZE == SpanTest::SPAN_WIDTH, "a block row is exactly one span");
+
+            auto raster_bin = [&](RasterPass pass) {
+                bool writes_depth = pass != RasterPass::VisibilityOnEqualDepth;
+
+                for(int index: bin) {
+                    auto& tri = triangles[index];
+
+                    // 整个三角形都在 tile 里已有的深度后面。相等时 z == depth 仍可能通过，所以 equal pass 用严格比较
+                    auto occluded = [&](float max_depth) {
+                        return writes_depth ? tri.z_min >= max_depth : tri.z_min > max_depth;
+                    };
+                    if(occluded(framebuffer.tile_max_depth[tile])) continue;
+
+                    int x_begin = std::max(tile_x0, tri.x_min), x_end = std::min(tile_x1, tri.x_max);
+                    int y_begin = std::max(tile_y0, tri.y_min), y_end = std::min(tile_y1, tri.y_max);
+
+                    SpanTest span;
+                    for(int i = 0; i < 3; i++) {
+                        span.step[i] = tri.edge_a[i];
+                        span.z[i] = tri.z[i];
+                    }
+                    span.inv_area = tri.inv_area;
+                    span.near = near;
+                    span.far = far;
+                    span.depth_equal = !writes_depth;
+
+                    bool tile_changed = false;
+
+                    for(int block_y = y_begin / BLOCK_SIZE * BLOCK_SIZE; block_y < y_end; block_y += BLOCK_SIZE) {
+                        for(int block_x = x_begin / BLOCK_SIZE * BLOCK_SIZE; block_x < x_end; block_x += BLOCK_SIZE) {
+                            if(occluded(framebuffer.block_max_depth_at(block_x, block_y))) continue;
+
+                            int xs = std::max(block_x, x_begin), xe = std::min(block_x + BLOCK_SIZE, x_end);
+                            int ys = std::max(block_y, y_begin), ye = std::min(block_y + BLOCK_SIZE, y_end);
+
+                            if(!tri.overlaps(xs, ys, xe, ye)) continue;
+
+                            // block 起点处求一次边函数，之后每行只做加法
+                            float e_row[3];
+                            for(int i = 0; i < 3; i++) {
+                                e_row[i] = tri.edge(i, xs, ys);
+                            }
+
+                            bool block_changed = false;
+
+                            for(int y_index = ys; y_index < ye; y_index++) {
+                                for(int i = 0; i < 3; i++) {
+                                    span.e[i] = e_row[i];
+                                    e_row[i] += tri.edge_b[i];
+                                }
+
+                                // tile 内一行是连续内存
+                                float* depth = framebuffer.depth_at(xs, y_index);
+                                VisibilitySample* samples = &framebuffer.visibility_at(xs, y_index);
+
+                                float z_lanes[SpanTest::SPAN_WIDTH];
+                                uint32_t mask = span_test(span, depth, xe - xs, z_lanes);
+
+                                if(writes_depth && mask) block_changed = true;
+
+                                while(mask) {
+                                    int lane = std::countr_zero(mask);
+                                    mask &= mask - 1;
+
+                                    if(pass == RasterPass::DepthOnly) {
+                                        depth[lane] = z_lanes[lane];
+                                        continue;
+                                    }
+                                    if(pass == RasterPass::VisibilityOnEqualDepth) {
+                                        // 深度相同时保持提交顺序靠前的三角形，与不开 prepass 时一致
+                                        if(samples[lane].triangle != VisibilitySample::EMPTY) continue;
+                                    } else {
+                                        depth[lane] = z_lanes[lane];
+                                    }
+                                    samples[lane] = VisibilitySample{
+                                        (uint32_t)index,
+                                        (span.e[1] + span.step[1] * (float)lane) * tri.inv_area,
+                                        (span.e[2] + span.step[2] * (float)lane) * tri.inv_area
+                                    };
                                 }
-                                f_buffer[x_index][y_index].first = &fragment;
-                                f_buffer[x_index][y_index].second = &pObj->getFShader();
-                            }   
+                            }
+
+                            if(block_changed) {
+                                framebuffer.update_block_max_depth(block_x, block_y);
+                                tile_changed = true;
+                            }
                         }
                     }
+
+                    if(tile_changed) {
+                        framebuffer.update_tile_max_depth(tile);
+                    }
                 }
-                v1.~AbstractVertex();
-                v2.~AbstractVertex();
-                v3.~AbstractVertex();
+            };
+
+            if(depth_prepass) {
+                raster_bin(RasterPass::DepthOnly);
+                raster_bin(RasterPass::VisibilityOnEqualDepth);
+            } else {
+                raster_bin(RasterPass::DepthAndVisibility);
             }
-        }
 
-        reset_mem();
+            // resolve：每个可见像素插值、着色一次。按 PACKET_WIDTH x PACKET_HEIGHT 的像素块处理，
+            // 块里属于同一物体的像素交给它的 DrawCall 一起着色
+            static_assert(TILE_SIZE % PACKET_WIDTH == 0 && TILE_SIZE % PACKET_HEIGHT == 0);
+            for(int y = tile_y0; y < tile_y1; y += PACKET_HEIGHT) {
+                for(int x = tile_x0; x < tile_x1; x += PACKET_WIDTH) {
+                    VisibilitySample samples[PACKET_LANES];
+                    RGBAColor colors[PACKET_LANES];
+                    uint32_t pending = 0;
+                    for(int i = 0; i < PACKET_LANES; i++) {
+                        int px = x + i % PACKET_WIDTH, py = y + i / PACKET_WIDTH;
+                        if(px >= tile_x1 || py >= tile_y1) continue;
+                        samples[i] = framebuffer.visibility_at(px, py);
+                        if(samples[i].triangle == VisibilitySample::EMPTY) {
+                            framebuffer.color.setPixel(px, py, RGBAColor{0, 0, 0, 1});
+                        } else {
+                            pending |= 1u << i;
+                        }
+                    }
 
-        Image image(width, height);
+                    while(pending) {
+                        uint32_t object = triangles[samples[std::countr_zero(pending)].triangle].object;
+                        uint32_t mask = 0;
+                        for(uint32_t m = pending; m; m &= m - 1) {
+                            int i = std::countr_zero(m);
+                            if(triangles[samples[i].triangle].object == object) mask |= 1u << i;
+                        }
+                        pending &= ~mask;
 
-        for(int x_index = 0; x_index < width; x_index++) {
-            for(int y_index = 0; y_index < height; y_index++) {
-                auto [fragment, shader] =  f_buffer[x_index][y_index];
-                if(fragment != nullptr) {
-                    image.setPixel(x_index, y_index, shader->shade(*fragment, uniform));
-                    fragment->~AbstractFragment();
+                        objects[object].draw->shade_fragments(triangles.data(), samples, mask, x, y, frame_uniform.value, colors);
+                        for(uint32_t m = mask; m; m &= m - 1) {
+                            int i = std::countr_zero(m);
+                            framebuffer.color.setPixel(x + i % PACKET_WIDTH, y + i / PACKET_WIDTH, colors[i]);
+                        }
+                    }
                 }
             }
+        };
+
+        thread_pool->run(framebuffer.n_tiles(), process_tile);
+
+        for(auto& desp: objects) {
+            desp.draw->end_frame();
         }
+        vertex_model.clear();
+        vertex_world.clear();
+        vertex_clip.clear();
+        vertex_outcode.clear();
+        triangles.clear();
 
-        return image;
+        return framebuffer.color;
     }
 
 };
\ No newline at end of file
@@ -5,9 +5,14 @@
 #include <algorithm>
 #include <memory>
 #include <any>
+#include <cmath>
+#include <type_traits>
+#include <cstdint>
 #include "matrix.hpp"
 #include "image.hpp"
 
+// Rasterizer 传给 VShader 的 info 每个物体一份。Property 里需要的部分按值保存，不要存指向 info 或 attribute 的指针：
+// 兼容接口 AbstractVShader::shade 拿到的 attribute 是 getVertexData 返回的临时对象
 class RasterizerInfo {
 public:
     Mat4 M;
@@ -32,13 +37,138 @@ public:
     virtual ~AbstractInterpolatable() {}
 };
 
+// 声明式的 varying 布局。Property 特化 VaryingLayout，按顺序列出需要插值的成员（float 或 Matrix），例如
+//     template <> struct VaryingLayout<MyProperty>: Varyings<&MyProperty::normal, &MyProperty::uv> {};
+// 之后插值只处理这些成员拼起来的 SIZE 个 float，不再需要 operator+ / operator*。
+// 没有列出的成员不插值，保留三角形第一个顶点的值。
+template <typename P>
+struct VaryingLayout {
+    static constexpr bool declared = false;
+};
+
+template <typename T>
+struct VaryingMember;
+
+template <>
+struct VaryingMember<float> {
+    static constexpr int SIZE = 1;
+    static float* floats(float& v) { return &v; }
+    static const float* floats(const float& v) { return &v; }
+};
+
+template <int M, int N>
+struct VaryingMember<Matrix<M, N>> {
+    static constexpr int SIZE = M * N;
+    static float* floats(Matrix<M, N>& v) { return v.raw(); }
+    static const float* floats(const Matrix<M, N>& v) { return v.raw(); }
+};
+
+template <typename T>
+struct MemberPointerTraits;
+
+template <typename C, typename T>
+struct MemberPointerTraits<T C::*> {
+    using Member = T;
+};
+
+template <auto... Members>
+struct Varyings {
+    static constexpr bool declared = true;
+    static constexpr int SIZE = (VaryingMember<typename MemberPointerTraits<decltype(Members)>::Member>::SIZE + ...);
+
+    // p 的 varying 依次写到 out[0, SIZE)
+    template <typename P>
+    static void gather(const P& p, float* out) {
+        auto copy = [&](const auto& member) {
+            using Member = VaryingMember<std::remove_cvref_t<decltype(member)>>;
+            const float* in = Member::floats(member);
+            for(int i = 0; i < Member::SIZE; i++) {
+                *out++ = in[i];
+            }
+        };
+        (copy(p.*Members), ...);
+    }
+
+    // Member 的第一个 float 在 varying 中的位置
+    template <auto Member>
+    static constexpr int offset_of() {
+        int offset = 0;
+        bool found = false;
+        auto visit = [&]<auto M>() {
+            if(found) return;
+            if constexpr (std::is_same_v<decltype(M), decltype(Member)>) {
+                if(M == Member) {
+                    found = true;
+                    return;
+                }
+            }
+            offset += VaryingMember<typename MemberPointerTraits<decltype(M)>::Member>::SIZE;
+        };
+        (visit.template operator()<Members>(), ...);
+        return offset;
+    }
+
+    // gather 的逆操作。第 j 个 float 在 in[j * stride]
+    template <typename P>
+    static void scatter(const float* in, P& p, int stride = 1) {
+        auto copy = [&](auto& member) {
+            using Member = VaryingMember<std::remove_cvref_t<decltype(member)>>;
+            float* out = Member::floats(member);
+            for(int i = 0; i < Member::SIZE; i++, in += stride) {
+                out[i] = *in;
+            }
+        };
+        (copy(p.*Members), ...);
+    }
+};
+
+// 硬件支持时用 fma，否则退化为乘加，避免 std::fma 的软件实现
+inline float varying_fma(float a, float b, float c) {
+#ifdef FP_FAST_FMAF
+    return std::fma(a, b, c);
+#else
+    return a * b + c;
+#endif
+}
+
+// 多个像素的 varying 按 SoA 插值：out[j * LANES + i] 是第 i 个像素的第 j 个 float。
+// v[t][i] 指向第 i 个像素所在三角形第 t 个顶点的 varying（SIZE 个 float），k[t][i] 是对应的权重。
+template <int SIZE, int LANES>
+void interpolate_varyings(const float* const v[3][LANES], const float k[3][LANES], int count, float* out) {
+    for(int j = 0; j < SIZE; j++) {
+        for(int i = 0; i < count; i++) {
+            out[j * LANES + i] = varying_fma(v[2][i][j], k[2][i], varying_fma(v[1][i][j], k[1][i], v[0][i][j] * k[0][i]));
+        }
+    }
+}
+
 template <typename T>
 concept Interpolatable = requires(const T& a, float k) {
     std::derived_from<T, AbstractInterpolatable>;
-
+} && (VaryingLayout<T>::declared || requires(const T& a, float k) {
     { a * k        } -> std::same_as<T>;
     { a + a        } -> std::same_as<T>;
-};
+});
+
+// p1 * k1 + p2 * k2 + p3 * k3。声明了 VaryingLayout 的只插值 varying
+template <typename P>
+P interpolate_properties(const P& p1, float k1, const P& p2, float k2, const P& p3, float k3) {
+    if constexpr (VaryingLayout<P>::declared) {
+        using Layout = VaryingLayout<P>;
+        float v[3][Layout::SIZE], out[Layout::SIZE];
+        Layout::gather(p1, v[0]);
+        Layout::gather(p2, v[1]);
+        Layout::gather(p3, v[2]);
+        for(int j = 0; j < Layout::SIZE; j++) {
+            out[j] = varying_fma(v[2][j], k3, varying_fma(v[1][j], k2, v[0][j] * k1));
+        }
+        P p = p1;
+        Layout::scatter(out, p);
+        return p;
+    } else {
+        return p1 * k1 + p2 * k2 + p3 * k3;
+    }
+}
 
 class AbstractFragment {
 public:
@@ -62,6 +192,54 @@ public:
     virtual const AbstractInterpolatable& getProperties() const override { return properties; }
 };
 
+// 片元按 PACKET_WIDTH x PACKET_HEIGHT 的像素块（两个 2x2 quad）成批处理，
+// lane i 对应块内的 (i % PACKET_WIDTH, i / PACKET_WIDTH)
+constexpr int PACKET_WIDTH = 4;
+constexpr int PACKET_HEIGHT = 2;
+constexpr int PACKET_LANES = PACKET_WIDTH * PACKET_HEIGHT;
+
+// 一个像素块中属于同一物体的片元，SoA 存放：
+// pos_world[c][i]、varyings[j][i] 是第 i 个像素的第 c 个坐标分量、第 j 个 varying float。
+// ddx / ddy 是 varying 在屏幕空间的导数：在像素自己的三角形上求右边、上边一个像素处的值再相减，
+// 相当于 quad 里的 helper lane，三角形边缘的像素也有导数。
+// 不插值的成员从 flat[i]（像素所在三角形第一个顶点的属性）读取。
+template <typename P>
+requires VaryingLayout<P>::declared
+struct FragmentPacket {
+    static constexpr int LANES = PACKET_LANES;
+    using Layout = VaryingLayout<P>;
+
+    uint32_t mask = 0;                      // 第 i 位为 1 表示第 i 个 lane 有像素
+    float pos_world[3][LANES];
+    float varyings[Layout::SIZE][LANES];
+    float ddx[Layout::SIZE][LANES];
+    float ddy[Layout::SIZE][LANES];
+    const P* flat[LANES];
+
+    // Member 在 varying 中的第 component 个 float，按 lane 连续
+    template <auto Member>
+    const float* varying(int component = 0) const {
+        return varyings[Layout::template offset_of<Member>() + component];
+    }
+
+    template <auto Member>
+    const float* varying_ddx(int component = 0) const {
+        return ddx[Layout::template offset_of<Member>() + component];
+    }
+
+    template <auto Member>
+    const float* varying_ddy(int component = 0) const {
+        return ddy[Layout::template offset_of<Member>() + component];
+    }
+
+    Fragment<P> fragment(int lane) const {
+        Fragment<P> out(*flat[lane]);
+        Layout::scatter(&varyings[0][lane], out.properties, LANES);
+        out.pos_world = { pos_world[0][lane], pos_world[1][lane], pos_world[2][lane] };
+        return out;
+    }
+};
+
 class AbstractVertex {
 public:
     Vec3 pos_model;
@@ -108,7 +286,7 @@ public:
         auto& p2 = dynamic_cast<const Vertex&>(v2).properties;
         auto& p3 = dynamic_cast<const Vertex&>(v3).properties;
         
-        auto p = p1 * k1 + p2 * k2 + p3 * k3;
+        auto p = interpolate_properties(p1, k1, p2, k2, p3, k3);
 
         auto frag = new (mem) Fragment(std::move(p)); 
       // frag->pos = this->pos * k1 + v2.pos * k2 + v3.pos * k3;
@@ -130,9 +308,19 @@ class FShader: public AbstractFShader {
 public:
     // Shader 因此是一个抽象类，无法实例化。TODO：可以看一下如何用 Module 阻止用户直接继承 AbstractShader
     virtual RGBAColor shade(const Fragment<P>& fragment, const Uniform& uniform) const = 0;
+
+    // 批量着色，out[i] 对应第 i 个 lane，mask 之外的不写。默认逐个调用 shade。
+    // 不是虚函数：子类用同样的签名隐藏它即可，Rasterizer 按具体类型静态调用，没有实现的就逐个像素调用 shade。
+    void shade_batch(const FragmentPacket<P>& packet, const Uniform& uniform, RGBAColor* out) const
+    requires VaryingLayout<P>::declared {
+        for(int i = 0; i < FragmentPacket<P>::LANES; i++) {
+            if(packet.mask & (1u << i)) out[i] = shade(packet.fragment(i), uniform);
+        }
+    }
+
     virtual RGBAColor shade(const AbstractFragment& fragment, const std::any& uniform) const override {
         auto& n_frag = dynamic_cast<const Fragment<P>&>(fragment);
-        auto n_uniform = std::any_cast<Uniform>(uniform);
+        auto& n_uniform = std::any_cast<const Uniform&>(uniform);
         return shade(n_frag, n_uniform);
     }
 };
@@ -162,19 +350,21 @@ public:
         const RasterizerInfo& info,
         void* mem
     ) const {
-        auto n_data = std::any_cast<VertexDataT>(data);
-        auto n_uniform = std::any_cast<Uniform>(uniform);
+        auto& n_data = std::any_cast<const VertexDataT&>(data);
+        auto& n_uniform = std::any_cast<const Uniform&>(uniform);
         Vertex<P> vertex = shade(n_data, n_uniform, info);
         // memcpy(mem, &vertex, sizeof(vertex));
         return *static_cast<AbstractVertex*>(new (mem) Vertex<P>(vertex));
     }
 };
 
+// 虚函数接口只作兼容保留：Rasterizer 在 addObject 时拿到具体类型，渲染时不经过这里
 class AbstractObject {
 public:
     std::vector<std::tuple<int, int, int>> triangles;
     
     virtual const std::any getVertexData(int) const = 0;
+    virtual int vertexCount() const = 0;
     virtual const AbstractVShader& getVShader() const = 0;
     virtual const AbstractFShader& getFShader() const = 0;
     virtual ~AbstractObject() {}
@@ -199,6 +389,10 @@ public:
         return val;
     }
 
+    virtual int vertexCount() const override {
+        return vertices.size();
+    }
+
     virtual const AbstractVShader& getVShader() const override {
         return vshader;
     }
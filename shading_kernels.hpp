@@ -0,0 +1,171 @@
+#pragma once
+
+#include "common_header.hpp"
+#include "raster_kernels.hpp"
+#include <cstdint>
+#include <cmath>
+#include <cfloat>
+#include <bit>
+#include <algorithm>
+
+// 像素块的 Blinn-Phong 光照：SHADING_LANES 个像素按 SoA 存放，每一步都在所有 lane 上做，没有分支。
+// 不在 mask 里的 lane 照样计算（输入为 0 时结果有限），由调用者在写回时丢掉。
+// pow 用 exp2(Ns * log2(x)) 的多项式近似，相对误差约 1e-6 * Ns，写回 8 位颜色时看不出来。
+
+constexpr int SHADING_LANES = 8;
+
+struct BlinnPhongLanes {
+    alignas(16) float pos[3][SHADING_LANES];     // 世界坐标
+    alignas(16) float n[3][SHADING_LANES];       // 单位法向量
+    alignas(16) float view[3][SHADING_LANES];    // 指向相机的单位向量
+    alignas(16) float kd[3][SHADING_LANES];      // Kd * 漫反射纹理
+    alignas(16) float ks[3][SHADING_LANES];      // Ks * 高光纹理
+    float Ns;
+};
+
+// log2(1 + t) / t 和 2^f 在 [0, 1) 上的最小二乘拟合，误差分别约 1.3e-6（绝对）、1e-7（相对）
+constexpr float SHADING_LOG2_POLY[7] = { 1.44269326f, -0.721162734f, 0.477705927f, -0.339247756f, 0.215588501f, -0.0960662218f, 0.020490337f };
+constexpr float SHADING_EXP2_POLY[6] = { 0.999999896f, 0.69315462f, 0.24014077f, 0.0558632821f, 0.0089462153f, 0.00189510704f };
+
+// x >= 0。x == 0 时得到 -127，之后的 exp2 会把它变成 0
+inline float shading_log2(float x) {
+    uint32_t bits = std::bit_cast<uint32_t>(x);
+    float e = (float)((int)(bits >> 23) - 127);
+    float t = std::bit_cast<float>((bits & 0x007fffff) | 0x3f800000) - 1;
+    float p = SHADING_LOG2_POLY[6];
+    for(int k = 5; k >= 0; k--) p = p * t + SHADING_LOG2_POLY[k];
+    return e + p * t;
+}
+
+inline float shading_exp2(float y) {
+    y = std::clamp(y, -126.0f, 127.99f);
+    float i = std::floor(y);
+    float f = y - i;
+    float p = SHADING_EXP2_POLY[5];
+    for(int k = 4; k >= 0; k--) p = p * f + SHADING_EXP2_POLY[k];
+    return p * std::bit_cast<float>((uint32_t)((int)i + 127) << 23);
+}
+
+inline void normalize_lanes_scalar(float v[3][SHADING_LANES]) {
+    for(int i = 0; i < SHADING_LANES; i++) {
+        float len2 = v[0][i] * v[0][i] + v[1][i] * v[1][i] + v[2][i] * v[2][i];
+        float inv = 1 / std::sqrt(std::max(len2, FLT_MIN));
+        for(int c = 0; c < 3; c++) v[c][i] *= inv;
+    }
+}
+
+// color += kd * intensity * max(0, n·l) / r² + ks * max(0, n·h)^Ns
+inline void blinn_phong_light_scalar(const BlinnPhongLanes& in, const float light_pos[3], const float intensity[3], float color[3][SHADING_LANES]) {
+    for(int i = 0; i < SHADING_LANES; i++) {
+        float l[3], h[3];
+        for(int c = 0; c < 3; c++) l[c] = light_pos[c] - in.pos[c][i];
+        float r_squared = std::max(l[0] * l[0] + l[1] * l[1] + l[2] * l[2], FLT_MIN);
+        float inv_r = 1 / std::sqrt(r_squared);
+        for(int c = 0; c < 3; c++) l[c] *= inv_r;
+
+        float k = std::max(0.0f, in.n[0][i] * l[0] + in.n[1][i] * l[1] + in.n[2][i] * l[2]);
+        float eff = k / r_squared;
+
+        for(int c = 0; c < 3; c++) h[c] = in.view[c][i] + l[c];
+        float inv_h = 1 / std::sqrt(std::max(h[0] * h[0] + h[1] * h[1] + h[2] * h[2], FLT_MIN));
+        float cos_h = std::max(0.0f, (in.n[0][i] * h[0] + in.n[1][i] * h[1] + in.n[2][i] * h[2]) * inv_h);
+        float spec = shading_exp2(in.Ns * shading_log2(cos_h));
+
+        for(int c = 0; c < 3; c++) {
+            color[c][i] += in.kd[c][i] * intensity[c] * eff + in.ks[c][i] * spec;
+        }
+    }
+}
+
+#ifdef RASTER_KERNELS_X86
+
+inline __m128 shading_log2_sse(__m128 x) {
+    __m128i bits = _mm_castps_si128(x);
+    __m128 e = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127)));
+    __m128i mantissa = _mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007fffff)), _mm_set1_epi32(0x3f800000));
+    __m128 t = _mm_sub_ps(_mm_castsi128_ps(mantissa), _mm_set1_ps(1));
+    __m128 p = _mm_set1_ps(SHADING_LOG2_POLY[6]);
+    for(int k = 5; k >= 0; k--) p = _mm_add_ps(_mm_mul_ps(p, t), _mm_set1_ps(SHADING_LOG2_POLY[k]));
+    return _mm_add_ps(e, _mm_mul_ps(p, t));
+}
+
+inline __m128 shading_exp2_sse(__m128 y) {
+    y = _mm_min_ps(_mm_max_ps(y, _mm_set1_ps(-126.0f)), _mm_set1_ps(127.99f));
+    // SSE2 没有 floor：截断后负数多减 1
+    __m128i i = _mm_cvttps_epi32(y);
+    __m128 fi = _mm_cvtepi32_ps(i);
+    __m128 too_big = _mm_cmpgt_ps(fi, y);
+    i = _mm_add_epi32(i, _mm_castps_si128(too_big));
+    fi = _mm_sub_ps(fi, _mm_and_ps(too_big, _mm_set1_ps(1)));
+    __m128 f = _mm_sub_ps(y, fi);
+    __m128 p = _mm_set1_ps(SHADING_EXP2_POLY[5]);
+    for(int k = 4; k >= 0; k--) p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(SHADING_EXP2_POLY[k]));
+    __m128 scale = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(i, _mm_set1_epi32(127)), 23));
+    return _mm_mul_ps(p, scale);
+}
+
+inline __m128 shading_dot_sse(const __m128 a[3], const __m128 b[3]) {
+    return _mm_add_ps(_mm_add_ps(_mm_mul_ps(a[0], b[0]), _mm_mul_ps(a[1], b[1])), _mm_mul_ps(a[2], b[2]));
+}
+
+inline __m128 shading_inv_length_sse(const __m128 v[3]) {
+    __m128 len2 = _mm_max_ps(shading_dot_sse(v, v), _mm_set1_ps(FLT_MIN));
+    return _mm_div_ps(_mm_set1_ps(1), _mm_sqrt_ps(len2));
+}
+
+inline void normalize_lanes_sse(float v[3][SHADING_LANES]) {
+    for(int half = 0; half < SHADING_LANES; half += 4) {
+        __m128 x[3];
+        for(int c = 0; c < 3; c++) x[c] = _mm_loadu_ps(v[c] + half);
+        __m128 inv = shading_inv_length_sse(x);
+        for(int c = 0; c < 3; c++) _mm_storeu_ps(v[c] + half, _mm_mul_ps(x[c], inv));
+    }
+}
+
+inline void blinn_phong_light_sse(const BlinnPhongLanes& in, const float light_pos[3], const float intensity[3], float color[3][SHADING_LANES]) {
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 Ns = _mm_set1_ps(in.Ns);
+    for(int half = 0; half < SHADING_LANES; half += 4) {
+        __m128 n[3], l[3], h[3];
+        for(int c = 0; c < 3; c++) {
+            n[c] = _mm_load_ps(in.n[c] + half);
+            l[c] = _mm_sub_ps(_mm_set1_ps(light_pos[c]), _mm_load_ps(in.pos[c] + half));
+        }
+        __m128 r_squared = _mm_max_ps(shading_dot_sse(l, l), _mm_set1_ps(FLT_MIN));
+        __m128 inv_r = _mm_div_ps(_mm_set1_ps(1), _mm_sqrt_ps(r_squared));
+        for(int c = 0; c < 3; c++) l[c] = _mm_mul_ps(l[c], inv_r);
+
+        __m128 k = _mm_max_ps(zero, shading_dot_sse(n, l));
+        __m128 eff = _mm_div_ps(k, r_squared);
+
+        for(int c = 0; c < 3; c++) h[c] = _mm_add_ps(_mm_load_ps(in.view[c] + half), l[c]);
+        __m128 cos_h = _mm_max_ps(zero, _mm_mul_ps(shading_dot_sse(n, h), shading_inv_length_sse(h)));
+        __m128 spec = shading_exp2_sse(_mm_mul_ps(Ns, shading_log2_sse(cos_h)));
+
+        for(int c = 0; c < 3; c++) {
+            __m128 diffuse = _mm_mul_ps(_mm_mul_ps(_mm_load_ps(in.kd[c] + half), _mm_set1_ps(intensity[c])), eff);
+            __m128 specular = _mm_mul_ps(_mm_load_ps(in.ks[c] + half), spec);
+            __m128 out = _mm_add_ps(_mm_loadu_ps(color[c] + half), _mm_add_ps(diffuse, specular));
+            _mm_storeu_ps(color[c] + half, out);
+        }
+    }
+}
+
+#endif
+
+// SSE2 在 x86-64 上总是可用，不需要运行时选择；其他平台用标量版本（同样没有分支，编译器可以自动向量化）
+inline void normalize_lanes(float v[3][SHADING_LANES]) {
+#ifdef RASTER_KERNELS_X86
+    normalize_lanes_sse(v);
+#else
+    normalize_lanes_scalar(v);
+#endif
+}
+
+inline void blinn_phong_light(const BlinnPhongLanes& in, const float light_pos[3], const float intensity[3], float color[3][SHADING_LANES]) {
+#ifdef RASTER_KERNELS_X86
+    blinn_phong_light_sse(in, light_pos, intensity, color);
+#else
+    blinn_phong_light_scalar(in, light_pos, intensity, color);
+#endif
+}
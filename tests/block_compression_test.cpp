@@ -0,0 +1,100 @@
+#include "../block_compression.hpp"
+#include <cstdio>
+#include <cmath>
+#include <vector>
+
+// BC1 / BC3 编码后再解码，和原图比较每个通道的 RMSE（按 [0, 1] 计）。
+// 图是平滑的渐变加少量噪声，和照片类纹理接近；编码器只用包围盒端点，误差上限留得比较宽。
+
+constexpr int SIZE = 64;
+constexpr double COLOR_RMSE_BOUND = 0.04;
+constexpr double ALPHA_RMSE_BOUND = 0.02;
+
+uint32_t pack(int r, int g, int b, int a) {
+    auto clamp = [](int v) { return (uint32_t)std::min(255, std::max(0, v)); };
+    return clamp(r) | (clamp(g) << 8) | (clamp(b) << 16) | (clamp(a) << 24);
+}
+
+std::vector<uint32_t> make_image() {
+    std::vector<uint32_t> image(SIZE * SIZE);
+    uint32_t seed = 12345;
+    auto noise = [&]() {
+        seed = seed * 1664525 + 1013904223;
+        return (int)(seed >> 29) - 4;   // [-4, 3]
+    };
+    for(int y = 0; y < SIZE; y++) {
+        for(int x = 0; x < SIZE; x++) {
+            int r = x * 255 / (SIZE - 1);
+            int g = y * 255 / (SIZE - 1);
+            int b = (int)(127.5 + 127.5 * std::sin(x * 0.2) * std::cos(y * 0.15));
+            int a = (x + y) * 255 / (2 * SIZE - 2);
+            image[y * SIZE + x] = pack(r + noise(), g + noise(), b + noise(), a + noise());
+        }
+    }
+    return image;
+}
+
+// 按 4x4 块编码再解码
+template <int WORDS>
+std::vector<uint32_t> round_trip(
+    const std::vector<uint32_t>& image,
+    void (*encode)(const uint32_t*, uint32_t*),
+    void (*decode)(const uint32_t*, uint32_t*)
+) {
+    std::vector<uint32_t> out(image.size());
+    for(int by = 0; by < SIZE; by += 4) {
+        for(int bx = 0; bx < SIZE; bx += 4) {
+            uint32_t texels[16], block[WORDS];
+            for(int i = 0; i < 16; i++) {
+                texels[i] = image[(by + i / 4) * SIZE + bx + i % 4];
+            }
+            encode(texels, block);
+            decode(block, texels);
+            for(int i = 0; i < 16; i++) {
+                out[(by + i / 4) * SIZE + bx + i % 4] = texels[i];
+            }
+        }
+    }
+    return out;
+}
+
+double rmse(const std::vector<uint32_t>& a, const std::vector<uint32_t>& b, int channel) {
+    double sum = 0;
+    for(size_t i = 0; i < a.size(); i++) {
+        double d = ((double)bc_channel(a[i], channel) - (double)bc_channel(b[i], channel)) / 255;
+        sum += d * d;
+    }
+    return std::sqrt(sum / a.size());
+}
+
+bool check(const char* name, double value, double bound) {
+    bool ok = value <= bound;
+    std::printf("%s: rmse %.4f (bound %.4f) %s\n", name, value, bound, ok ? "ok" : "FAILED");
+    return ok;
+}
+
+int main() {
+    auto image = make_image();
+    bool ok = true;
+
+    auto bc1 = round_trip<BC1_BLOCK_WORDS>(image, bc1_encode_block, bc1_decode_block);
+    for(int c = 0; c < 3; c++) {
+        ok &= check(c == 0 ? "bc1 r" : c == 1 ? "bc1 g" : "bc1 b", rmse(image, bc1, c), COLOR_RMSE_BOUND);
+    }
+    // 编码器总是写四色块，解码结果不透明
+    for(uint32_t texel: bc1) {
+        if(bc_channel(texel, 3) != 255) {
+            std::printf("bc1: decoded alpha is not opaque FAILED\n");
+            ok = false;
+            break;
+        }
+    }
+
+    auto bc3 = round_trip<BC3_BLOCK_WORDS>(image, bc3_encode_block, bc3_decode_block);
+    for(int c = 0; c < 3; c++) {
+        ok &= check(c == 0 ? "bc3 r" : c == 1 ? "bc3 g" : "bc3 b", rmse(image, bc3, c), COLOR_RMSE_BOUND);
+    }
+    ok &= check("bc3 a", rmse(image, bc3, 3), ALPHA_RMSE_BOUND);
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,99 @@
+#include "../matrix.hpp"
+#include <cstdio>
+#include <cmath>
+#include <random>
+
+// 表达式模板（惰性求值）和逐元素循环（立即求值）的结果比较，包括目标矩阵同时出现在右边的情况。
+// 两边的运算顺序相同，误差只可能来自编译器是否把乘加合并成 fma，所以只留很小的容差。
+
+constexpr float TOLERANCE = 1e-5f;
+
+std::mt19937 rng(20240601);
+
+template<int M, int N>
+Matrix<M, N> random_matrix() {
+    std::uniform_real_distribution<float> dist(-10, 10);
+    Matrix<M, N> out;
+    for(int k = 0; k < M * N; k++) out.raw()[k] = dist(rng);
+    return out;
+}
+
+float random_scalar() {
+    return std::uniform_real_distribution<float>(-3, 3)(rng);
+}
+
+// f(k) 是第 k 个元素的期望值，需要在修改 actual 之前算好
+template<int M, int N, typename F>
+bool check(const char* name, const Matrix<M, N>& actual, F expected) {
+    for(int k = 0; k < M * N; k++) {
+        float e = expected(k);
+        if(std::fabs(actual.at(k) - e) > TOLERANCE * std::max(1.0f, std::fabs(e))) {
+            std::printf("%s<%d, %d>: element %d is %g, expected %g FAILED\n", name, M, N, k, actual.at(k), e);
+            return false;
+        }
+    }
+    return true;
+}
+
+template<int M, int N>
+bool test_shape() {
+    using Mat = Matrix<M, N>;
+    bool ok = true;
+    for(int round = 0; round < 100; round++) {
+        Mat a = random_matrix<M, N>(), b = random_matrix<M, N>(), c = random_matrix<M, N>();
+        float k = random_scalar(), k1 = random_scalar(), k2 = random_scalar();
+
+        Mat r = a * k1 + b * k2 - c;
+        ok &= check("a * k1 + b * k2 - c", r, [&](int i) { return a.at(i) * k1 + b.at(i) * k2 - c.at(i); });
+
+        r = (a - b) * k;
+        ok &= check("(a - b) * k", r, [&](int i) { return (a.at(i) - b.at(i)) * k; });
+
+        r = ((a + b) * k1 - (c - a) * k2) * k;
+        ok &= check("((a + b) * k1 - (c - a) * k2) * k", r, [&](int i) {
+            return ((a.at(i) + b.at(i)) * k1 - (c.at(i) - a.at(i)) * k2) * k;
+        });
+
+        // 右值叶子按值保存，表达式在临时对象销毁之后求值
+        auto expr = random_matrix<M, N>() * 0 + a;
+        r = expr;
+        ok &= check("temporary * 0 + a", r, [&](int i) { return a.at(i); });
+
+        // 别名：目标同时是操作数
+        Mat x = a;
+        Mat before = x;
+        x = x + b;
+        ok &= check("a = a + b", x, [&](int i) { return before.at(i) + b.at(i); });
+
+        before = x;
+        x = b - x;
+        ok &= check("a = b - a", x, [&](int i) { return b.at(i) - before.at(i); });
+
+        before = x;
+        x = (x - b) * k + x * k1;
+        ok &= check("a = (a - b) * k + a * k1", x, [&](int i) { return (before.at(i) - b.at(i)) * k + before.at(i) * k1; });
+
+        before = x;
+        x += x * k;
+        ok &= check("a += a * k", x, [&](int i) { return before.at(i) + before.at(i) * k; });
+
+        before = x;
+        x -= b * k - x;
+        ok &= check("a -= b * k - a", x, [&](int i) { return before.at(i) - (b.at(i) * k - before.at(i)); });
+    }
+    return ok;
+}
+
+// 常量求值走同一套表达式
+static_assert((Vec3{ 1, 2, 3 } * 2 - Vec3{ 1, 1, 1 }).eval()[2] == 5);
+
+int main() {
+    bool ok = true;
+    ok &= test_shape<3, 1>();
+    ok &= test_shape<4, 1>();
+    ok &= test_shape<3, 3>();
+    ok &= test_shape<4, 4>();
+    ok &= test_shape<2, 3>();
+    std::printf("%s\n", ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,92 @@
+#include "../texture.hpp"
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+#include <utility>
+
+// Texture::load 对 .bct 的检查：正常保存的文件能读回，损坏的文件抛 simple_exception 而不是崩溃或分配巨大的内存。
+// 损坏的文件按 save 的格式手工拼出来：header（magic、version、format、层数），每层 (width, height) 加上压缩块。
+
+constexpr uint32_t MAGIC = 0x58544342;
+constexpr uint32_t VERSION = 1;
+
+// levels 里的尺寸原样写入；with_data 为 false 时只写尺寸，模拟截断的文件
+void write_bct(const std::string& path, uint32_t n_levels, const std::vector<std::pair<uint32_t, uint32_t>>& levels, bool with_data = true) {
+    std::ofstream out(path, std::ios::binary);
+    uint32_t header[4] = { MAGIC, VERSION, (uint32_t)TextureFormat::BC1, n_levels };
+    out.write((const char*)header, sizeof(header));
+    for(auto [w, h]: levels) {
+        uint32_t size[2] = { w, h };
+        out.write((const char*)size, sizeof(size));
+        if(with_data) {
+            std::vector<uint32_t> blocks((size_t)((w + 3) / 4) * ((h + 3) / 4) * BC1_BLOCK_WORDS, 0);
+            out.write((const char*)blocks.data(), blocks.size() * sizeof(uint32_t));
+        }
+    }
+}
+
+bool expect_invalid(const char* name, const std::string& path) {
+    try {
+        Texture::load(path);
+    } catch(const simple_exception& e) {
+        std::printf("%s: rejected (%s) ok\n", name, e.what());
+        return true;
+    }
+    std::printf("%s: accepted FAILED\n", name);
+    return false;
+}
+
+int main() {
+    auto dir = std::filesystem::temp_directory_path();
+    std::string path = (dir / "texture_file_test.bct").string();
+    bool ok = true;
+
+    // 正常的文件：5x3 -> 2x1 -> 1x1
+    {
+        Texture texture(Image(5, 3, 4), TextureFilter::Trilinear, TextureWrap::Repeat, TextureFormat::BC3);
+        texture.save(path);
+        try {
+            Texture loaded = Texture::load(path);
+            bool same = loaded.width() == 5 && loaded.height() == 3 && loaded.n_levels() == 3 && loaded.storage_format() == TextureFormat::BC3;
+            std::printf("round trip: %s\n", same ? "ok" : "FAILED");
+            ok &= same;
+        } catch(const std::exception& e) {
+            std::printf("round trip: %s FAILED\n", e.what());
+            ok = false;
+        }
+    }
+
+    write_bct(path, 3, { { 5, 3 }, { 2, 1 }, { 1, 1 } });
+    try {
+        Texture::load(path);
+        std::printf("handmade chain: ok\n");
+    } catch(const std::exception& e) {
+        std::printf("handmade chain: %s FAILED\n", e.what());
+        ok = false;
+    }
+
+    write_bct(path, 1, { { 0, 4 } });
+    ok &= expect_invalid("zero width", path);
+
+    write_bct(path, 3, { { 4, 0 }, { 2, 1 }, { 1, 1 } });
+    ok &= expect_invalid("zero height", path);
+
+    write_bct(path, 1, { { 0x40000000, 0x40000000 } }, false);
+    ok &= expect_invalid("huge base level", path);
+
+    write_bct(path, 3, { { 8, 8 }, { 3, 4 }, { 1, 1 } });
+    ok &= expect_invalid("level does not halve", path);
+
+    write_bct(path, 2, { { 4, 4 }, { 2, 2 } });
+    ok &= expect_invalid("missing levels", path);
+
+    write_bct(path, 3, { { 2, 2 }, { 1, 1 }, { 1, 1 } });
+    ok &= expect_invalid("extra level", path);
+
+    write_bct(path, 3, { { 4, 4 } }, false);
+    ok &= expect_invalid("truncated", path);
+
+    std::filesystem::remove(path);
+    return ok ? 0 : 1;
+}
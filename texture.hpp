@@ -0,0 +1,417 @@
+#pragma once
+
+#include "common_header.hpp"
+#include "image.hpp"
+#include "matrix.hpp"
+#include "aligned_buffer.hpp"
+#include "block_compression.hpp"
+#include "utils.hpp"
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <format>
+#include <string>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define TEXTURE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+enum class TextureFilter {
+    Nearest,    // 最近的 mip 层级上取最近的 texel
+    Bilinear,   // 最近的 mip 层级上双线性插值
+    Trilinear,  // 相邻两个 mip 层级上双线性插值，再按 lod 线性插值
+};
+
+enum class TextureWrap {
+    Clamp,
+    Repeat,
+    Mirror,
+};
+
+// 存储格式。BCn 的一个块正好对应一个 TILE x TILE 的块，采样时按块解码
+enum class TextureFormat : uint32_t {
+    RGBA8 = 0,
+    BC1 = 1,    // RGB，4 bpp
+    BC3 = 2,    // RGBA，8 bpp
+};
+
+// 加载时从 Image 生成完整的 mip 链（每层宽高减半，2x2 box filter），之后只读。
+// texel 坐标与 Image::getPixel 一致：原点在左下，uv = (0, 0) 是第 0 个 texel 的左下角。
+//
+// 每层按 TILE x TILE 的块存放：块按行排列，块内 16 个 RGBA8 texel 也按行排列，正好是一条对齐的 cache line。
+// 屏幕上相邻的像素、双线性的 2x2 footprint 大多落在同一块里，不再每次都跨行。
+//
+// BC1 / BC3 格式下每个块存成一个压缩块（块内第 0 行同样是 y 最小的一行），采样时解码整块，
+// 解码结果放在每个线程自己的小缓存里，相邻的采样大多直接命中。
+// save / load 读写自己的容器格式（.bct），由 texture_compressor 离线生成。
+class Texture {
+public:
+    static constexpr int TILE = 4;
+
+    struct Level {
+        int width = 0;
+        int height = 0;
+        int tiles_x = 0;
+        int words_per_tile = TILE * TILE;
+        float fwidth = 0;                   // 采样时直接乘，不做除法
+        float fheight = 0;
+        AlignedBuffer<uint32_t> data;       // RGBA8 时是 texel（r 在最低字节），否则是压缩块
+
+        void resize(int w, int h, int words = TILE * TILE) {
+            width = w;
+            height = h;
+            tiles_x = (w + TILE - 1) / TILE;
+            int tiles_y = (h + TILE - 1) / TILE;
+            words_per_tile = words;
+            data.resize((size_t)tiles_x * tiles_y * words);
+            std::fill_n(data.data(), data.size(), 0u);
+            fwidth = (float)w;
+            fheight = (float)h;
+        }
+
+        const uint32_t* tile(int tx, int ty) const {
+            return data.data() + ((size_t)ty * tiles_x + tx) * words_per_tile;
+        }
+
+        // 只用于 RGBA8
+        size_t index(int x, int y) const {
+            size_t tile = (size_t)(y / TILE) * tiles_x + x / TILE;
+            return tile * TILE * TILE + (y % TILE) * TILE + x % TILE;
+        }
+
+        uint32_t texel(int x, int y) const { return data[index(x, y)]; }
+        uint32_t& texel(int x, int y) { return data[index(x, y)]; }
+    };
+
+private:
+    static constexpr float INV_255 = 1.0f / 255;
+    static constexpr uint32_t FILE_MAGIC = 0x58544342; // "BCTX"
+    static constexpr uint32_t FILE_VERSION = 1;
+    static constexpr uint32_t MAX_FILE_SIZE = 16384;           // .bct 第 0 层的边长上限
+    static constexpr size_t MAX_FILE_BYTES = (size_t)1 << 31;  // .bct 所有层的总大小上限
+    static constexpr int BLOCK_CACHE_SIZE = 256;
+
+    inline static std::atomic<uint64_t> next_id = 1;
+
+    uint64_t id = 0;    // 区分解码缓存里不同纹理的块，内存地址会被复用
+    TextureFormat format = TextureFormat::RGBA8;
+    std::vector<Level> levels;
+
+    static int words_per_tile(TextureFormat format) {
+        switch(format) {
+            case TextureFormat::BC1: return BC1_BLOCK_WORDS;
+            case TextureFormat::BC3: return BC3_BLOCK_WORDS;
+            default: return TILE * TILE;
+        }
+    }
+
+    // 线程私有、直接映射的解码缓存
+    const uint32_t* decoded_tile(const Level& level, int tx, int ty) const {
+        struct Entry {
+            uint64_t texture = 0;
+            const uint32_t* block = nullptr;
+            uint32_t texels[TILE * TILE];
+        };
+        thread_local Entry cache[BLOCK_CACHE_SIZE];
+
+        const uint32_t* block = level.tile(tx, ty);
+        auto& entry = cache[((uintptr_t)block / (sizeof(uint32_t) * level.words_per_tile)) % BLOCK_CACHE_SIZE];
+        if(entry.block != block || entry.texture != id) {
+            if(format == TextureFormat::BC1) {
+                bc1_decode_block(block, entry.texels);
+            } else {
+                bc3_decode_block(block, entry.texels);
+            }
+            entry.block = block;
+            entry.texture = id;
+        }
+        return entry.texels;
+    }
+
+    // 把 RGBA8 的各层压缩成 format。边缘不满的块用边上的 texel 补齐，避免影响端点
+    void compress(TextureFormat target) {
+        if(target == TextureFormat::RGBA8) return;
+        for(auto& level: levels) {
+            Level packed;
+            packed.resize(level.width, level.height, words_per_tile(target));
+            for(int ty = 0; ty * TILE < level.height; ty++) {
+                for(int tx = 0; tx * TILE < level.width; tx++) {
+                    uint32_t texels[TILE * TILE];
+                    for(int i = 0; i < TILE * TILE; i++) {
+                        int x = std::min(tx * TILE + i % TILE, level.width - 1);
+                        int y = std::min(ty * TILE + i / TILE, level.height - 1);
+                        texels[i] = level.texel(x, y);
+                    }
+                    uint32_t* block = packed.data.data() + ((size_t)ty * packed.tiles_x + tx) * packed.words_per_tile;
+                    if(target == TextureFormat::BC1) {
+                        bc1_encode_block(texels, block);
+                    } else {
+                        bc3_encode_block(texels, block);
+                    }
+                }
+            }
+            level = std::move(packed);
+        }
+        format = target;
+    }
+
+    static uint32_t pack(uint32_t r, uint32_t g, uint32_t b, uint32_t a) {
+        return r | (g << 8) | (b << 16) | (a << 24);
+    }
+
+    static uint32_t channel(uint32_t texel, int c) {
+        return (texel >> (8 * c)) & 0xff;
+    }
+
+    static RGBAColor decode(uint32_t texel) {
+        return RGBAColor{
+            channel(texel, 0) * INV_255,
+            channel(texel, 1) * INV_255,
+            channel(texel, 2) * INV_255,
+            channel(texel, 3) * INV_255
+        };
+    }
+
+    int wrap_coord(int i, int n) const {
+        switch(wrap) {
+            case TextureWrap::Clamp:
+                return std::clamp(i, 0, n - 1);
+            case TextureWrap::Repeat:
+                i %= n;
+                return i < 0 ? i + n : i;
+            default: {
+                int period = 2 * n;
+                i %= period;
+                if(i < 0) i += period;
+                return i < n ? i : period - 1 - i;
+            }
+        }
+    }
+
+    uint32_t fetch(const Level& level, int x, int y) const {
+        x = wrap_coord(x, level.width);
+        y = wrap_coord(y, level.height);
+        if(format == TextureFormat::RGBA8) {
+            return level.texel(x, y);
+        }
+        return decoded_tile(level, x / TILE, y / TILE)[(y % TILE) * TILE + x % TILE];
+    }
+
+    RGBAColor sample_nearest(const Level& level, float u, float v) const {
+        int x = (int)std::floor(u * level.fwidth);
+        int y = (int)std::floor(v * level.fheight);
+        return decode(fetch(level, x, y));
+    }
+
+    RGBAColor sample_bilinear(const Level& level, float u, float v) const {
+        float fx = u * level.fwidth - 0.5f;
+        float fy = v * level.fheight - 0.5f;
+        float x0f = std::floor(fx), y0f = std::floor(fy);
+        float tx = fx - x0f, ty = fy - y0f;
+        int x0 = (int)x0f, y0 = (int)y0f;
+
+        uint32_t t00 = fetch(level, x0, y0);
+        uint32_t t10 = fetch(level, x0 + 1, y0);
+        uint32_t t01 = fetch(level, x0, y0 + 1);
+        uint32_t t11 = fetch(level, x0 + 1, y0 + 1);
+
+#ifdef TEXTURE_SSE2
+        // 四个通道一起解码、插值，与下面的标量路径逐位相同
+        const __m128i zero = _mm_setzero_si128();
+        auto unpack = [&](uint32_t t) {
+            __m128i bytes = _mm_cvtsi32_si128((int)t);
+            return _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(bytes, zero), zero));
+        };
+        __m128 c00 = unpack(t00), c10 = unpack(t10), c01 = unpack(t01), c11 = unpack(t11);
+        __m128 vtx = _mm_set1_ps(tx), vty = _mm_set1_ps(ty);
+        __m128 bottom = _mm_add_ps(c00, _mm_mul_ps(_mm_sub_ps(c10, c00), vtx));
+        __m128 top = _mm_add_ps(c01, _mm_mul_ps(_mm_sub_ps(c11, c01), vtx));
+        __m128 mixed = _mm_mul_ps(_mm_add_ps(bottom, _mm_mul_ps(_mm_sub_ps(top, bottom), vty)), _mm_set1_ps(INV_255));
+        alignas(16) float out[4];
+        _mm_store_ps(out, mixed);
+#else
+        float out[4];
+        for(int c = 0; c < 4; c++) {
+            float c00 = (float)channel(t00, c), c10 = (float)channel(t10, c);
+            float c01 = (float)channel(t01, c), c11 = (float)channel(t11, c);
+            float bottom = c00 + (c10 - c00) * tx;
+            float top = c01 + (c11 - c01) * tx;
+            out[c] = (bottom + (top - bottom) * ty) * INV_255;
+        }
+#endif
+        return RGBAColor{ out[0], out[1], out[2], out[3] };
+    }
+
+    RGBAColor sample_level(int level, float u, float v) const {
+        if(filter == TextureFilter::Nearest) {
+            return sample_nearest(levels[level], u, v);
+        }
+        return sample_bilinear(levels[level], u, v);
+    }
+
+public:
+    TextureFilter filter = TextureFilter::Trilinear;
+    TextureWrap wrap = TextureWrap::Repeat;
+
+    Texture() = default;
+
+    explicit Texture(
+        const Image& image,
+        TextureFilter filter = TextureFilter::Trilinear,
+        TextureWrap wrap = TextureWrap::Repeat,
+        TextureFormat format = TextureFormat::RGBA8
+    ): id(next_id++), filter(filter), wrap(wrap) {
+        auto [width, height, n_channels] = image.shape();
+        if(width <= 0 || height <= 0) {
+            throw simple_exception("error: cannot create a texture from an empty image.");
+        }
+
+        // Image 按行从上往下存放
+        Level base;
+        base.resize(width, height);
+        const unsigned char* data = image.data();
+        for(int y = 0; y < height; y++) {
+            const unsigned char* row = data + (size_t)(height - 1 - y) * width * n_channels;
+            for(int x = 0; x < width; x++) {
+                const unsigned char* p = row + (size_t)x * n_channels;
+                base.texel(x, y) = pack(p[0], p[1], p[2], n_channels == 4 ? p[3] : 255);
+            }
+        }
+        levels.push_back(std::move(base));
+
+        while(levels.back().width > 1 || levels.back().height > 1) {
+            const Level& prev = levels.back();
+            Level next;
+            next.resize(std::max(1, prev.width / 2), std::max(1, prev.height / 2));
+            for(int y = 0; y < next.height; y++) {
+                int y0 = std::min(2 * y, prev.height - 1), y1 = std::min(2 * y + 1, prev.height - 1);
+                for(int x = 0; x < next.width; x++) {
+                    int x0 = std::min(2 * x, prev.width - 1), x1 = std::min(2 * x + 1, prev.width - 1);
+                    uint32_t t[4] = { prev.texel(x0, y0), prev.texel(x1, y0), prev.texel(x0, y1), prev.texel(x1, y1) };
+                    uint32_t c[4];
+                    for(int k = 0; k < 4; k++) {
+                        c[k] = (channel(t[0], k) + channel(t[1], k) + channel(t[2], k) + channel(t[3], k) + 2) / 4;
+                    }
+                    next.texel(x, y) = pack(c[0], c[1], c[2], c[3]);
+                }
+            }
+            levels.push_back(std::move(next));
+        }
+
+        compress(format);
+    }
+
+    // 读取 texture_compressor 生成的 .bct 文件
+    static Texture load(const std::string& path, TextureFilter filter = TextureFilter::Trilinear, TextureWrap wrap = TextureWrap::Repeat) {
+        std::ifstream in(path, std::ios::binary);
+        auto read = [&](void* dst, size_t size) {
+            if(!in.read((char*)dst, size)) {
+                throw simple_exception(std::format("error: `{}` is not a valid texture file.", path));
+            }
+        };
+
+        auto invalid = [&](const char* reason) {
+            return simple_exception(std::format("error: `{}` is not a valid texture file: {}.", path, reason));
+        };
+
+        uint32_t header[4];
+        read(header, sizeof(header));
+        if(header[0] != FILE_MAGIC || header[1] != FILE_VERSION || header[2] > (uint32_t)TextureFormat::BC3 || header[3] == 0) {
+            throw simple_exception(std::format("error: `{}` is not a valid texture file.", path));
+        }
+
+        Texture texture;
+        texture.id = next_id++;
+        texture.filter = filter;
+        texture.wrap = wrap;
+        texture.format = (TextureFormat)header[2];
+        // 各层必须是构造函数生成的完整 mip 链：每层是上一层的一半（至少为 1），最后一层 1x1。
+        // 尺寸在分配之前检查，损坏的文件不会导致除零（wrap_coord）或巨大的分配
+        size_t total_bytes = 0;
+        for(uint32_t i = 0; i < header[3]; i++) {
+            uint32_t size[2];
+            read(size, sizeof(size));
+            if(i == 0) {
+                if(size[0] == 0 || size[1] == 0) throw invalid("empty base level");
+                if(size[0] > MAX_FILE_SIZE || size[1] > MAX_FILE_SIZE) throw invalid("base level too large");
+            } else {
+                const Level& prev = texture.levels.back();
+                if(prev.width == 1 && prev.height == 1) throw invalid("too many mip levels");
+                if(size[0] != (uint32_t)std::max(1, prev.width / 2) || size[1] != (uint32_t)std::max(1, prev.height / 2)) {
+                    throw invalid("mip level sizes do not halve");
+                }
+            }
+
+            int words = words_per_tile(texture.format);
+            size_t tiles = (size_t)((size[0] + TILE - 1) / TILE) * ((size[1] + TILE - 1) / TILE);
+            total_bytes += tiles * words * sizeof(uint32_t);
+            if(total_bytes > MAX_FILE_BYTES) throw invalid("too large");
+
+            Level level;
+            level.resize((int)size[0], (int)size[1], words);
+            read(level.data.data(), level.data.size() * sizeof(uint32_t));
+            texture.levels.push_back(std::move(level));
+        }
+        if(texture.levels.back().width != 1 || texture.levels.back().height != 1) {
+            throw invalid("incomplete mip chain");
+        }
+        return texture;
+    }
+
+    void save(const std::string& path) const {
+        std::ofstream out(path, std::ios::binary);
+        uint32_t header[4] = { FILE_MAGIC, FILE_VERSION, (uint32_t)format, (uint32_t)levels.size() };
+        out.write((const char*)header, sizeof(header));
+        for(auto& level: levels) {
+            uint32_t size[2] = { (uint32_t)level.width, (uint32_t)level.height };
+            out.write((const char*)size, sizeof(size));
+            out.write((const char*)level.data.data(), level.data.size() * sizeof(uint32_t));
+        }
+        if(!out) {
+            throw simple_exception(std::format("error: failed to write texture file `{}`.", path));
+        }
+    }
+
+    int width() const { return levels[0].width; }
+    int height() const { return levels[0].height; }
+    int n_levels() const { return (int)levels.size(); }
+    const Level& level(int i) const { return levels[i]; }
+    TextureFormat storage_format() const { return format; }
+
+    size_t memory_size() const {
+        size_t size = 0;
+        for(auto& level: levels) {
+            size += level.data.size() * sizeof(uint32_t);
+        }
+        return size;
+    }
+
+    // uv 在屏幕空间的导数 -> mip 层级（0 为原图）。取 x、y 方向 texel 跨度的较大者
+    float lod(float dudx, float dvdx, float dudy, float dvdy) const {
+        float w = levels[0].fwidth, h = levels[0].fheight;
+        float rx = (dudx * w) * (dudx * w) + (dvdx * h) * (dvdx * h);
+        float ry = (dudy * w) * (dudy * w) + (dvdy * h) * (dvdy * h);
+        return 0.5f * std::log2(std::max(rx, ry));
+    }
+
+    RGBAColor sample(const Vec2& uv, float lod = 0) const {
+        float u = uv[0], v = uv[1];
+        float max_level = (float)(levels.size() - 1);
+        lod = std::isnan(lod) ? 0 : std::clamp(lod, 0.0f, max_level);
+
+        if(filter != TextureFilter::Trilinear) {
+            return sample_level((int)std::lround(lod), u, v);
+        }
+
+        int l0 = (int)lod;
+        float t = lod - (float)l0;
+        RGBAColor c0 = sample_level(l0, u, v);
+        if(t == 0) return c0;
+        RGBAColor c1 = sample_level(l0 + 1, u, v);
+        return c0 * (1 - t) + c1 * t;
+    }
+};
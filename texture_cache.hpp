@@ -0,0 +1,121 @@
+#pragma once
+
+#include "common_header.hpp"
+#include "texture.hpp"
+#include "image.hpp"
+#include "utils.hpp"
+#include <memory>
+#include <string>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <filesystem>
+#include <format>
+#include <iostream>
+
+// 进程内共享的纹理缓存。key 是规范化后的路径加上文件的修改时间，文件被改写后会重新加载。
+// 超出内存预算时按 LRU 丢掉缓存持有的引用；还在被 mesh 使用的纹理由 shared_ptr 保持存活，不会失效。
+// 同目录下有 texture_compressor 生成的 .bct、且不比原图旧时读取它，否则解码原图。
+class TextureCache {
+    struct Entry {
+        std::shared_ptr<const Texture> texture;
+        size_t size;
+        std::list<std::string>::iterator lru;
+    };
+
+    std::mutex mutex;
+    std::unordered_map<std::string, Entry> entries;
+    std::list<std::string> lru;     // 前面是最近使用的
+    size_t budget = (size_t)1 << 30;
+    size_t used = 0;
+
+    TextureCache() = default;
+
+    // 调用者持有锁
+    void evict() {
+        while(used > budget && !lru.empty()) {
+            auto it = entries.find(lru.back());
+            used -= it->second.size;
+            entries.erase(it);
+            lru.pop_back();
+        }
+    }
+
+    static std::string make_key(const std::filesystem::path& path) {
+        auto canonical = std::filesystem::canonical(path);
+        auto mtime = std::filesystem::last_write_time(canonical).time_since_epoch().count();
+        return std::format("{}|{}", canonical.string(), mtime);
+    }
+
+public:
+    TextureCache(const TextureCache&) = delete;
+    TextureCache& operator=(const TextureCache&) = delete;
+
+    static TextureCache& instance() {
+        static TextureCache cache;
+        return cache;
+    }
+
+    std::shared_ptr<const Texture> load(const std::string& path) {
+        // 原图比 .bct 新时说明 .bct 过期了，改为解码原图
+        std::filesystem::path bct = path + ".bct", source = path;
+        bool has_bct = std::filesystem::exists(bct), has_source = std::filesystem::exists(source);
+        bool stale = has_bct && has_source && std::filesystem::last_write_time(bct) < std::filesystem::last_write_time(source);
+        bool compressed = has_bct && !stale;
+        if(compressed) {
+            source = bct;
+        } else if(!has_source) {
+            throw simple_exception(std::format("error: texture `{}` not found.", path));
+        }
+        auto key = make_key(source);
+
+        {
+            std::lock_guard lock(mutex);
+            auto it = entries.find(key);
+            if(it != entries.end()) {
+                lru.splice(lru.begin(), lru, it->second.lru);
+                return it->second.texture;
+            }
+        }
+
+        if(stale) {
+            std::cerr << std::format("warning: `{}` is older than `{}`, ignoring it.", bct.string(), path) << std::endl;
+        }
+
+        // 解码不持锁，其他线程可以同时命中别的纹理。同一文件被并发加载时保留先插入的那份
+        std::shared_ptr<const Texture> texture = compressed
+            ? std::make_shared<Texture>(Texture::load(source.string()))
+            : std::make_shared<Texture>(Image(source.string(), false, false));
+
+        std::lock_guard lock(mutex);
+        auto [it, inserted] = entries.try_emplace(key);
+        if(inserted) {
+            lru.push_front(key);
+            it->second = Entry{ texture, texture->memory_size(), lru.begin() };
+            used += it->second.size;
+            evict();
+            return texture;
+        }
+        lru.splice(lru.begin(), lru, it->second.lru);
+        return it->second.texture;
+    }
+
+    // 缓存持有的纹理总大小上限（字节）
+    void set_budget(size_t bytes) {
+        std::lock_guard lock(mutex);
+        budget = bytes;
+        evict();
+    }
+
+    size_t memory_size() {
+        std::lock_guard lock(mutex);
+        return used;
+    }
+
+    void clear() {
+        std::lock_guard lock(mutex);
+        entries.clear();
+        lru.clear();
+        used = 0;
+    }
+};
@@ -0,0 +1,55 @@
+#include "common_header.hpp"
+#include "image.hpp"
+#include "texture.hpp"
+#include <iostream>
+#include <format>
+#include <string>
+
+// 把图片离线压缩成 BCn 的 mip 链（.bct），ld_obj_loader 会优先读取同名的 .bct 文件（比原图旧时忽略）。
+// 用法：texture_compressor <image> [bc1|bc3] [output]
+// 默认四通道用 BC3，其余用 BC1；默认输出为 <image>.bct
+
+int main(int argc, char** argv) {
+	if(argc < 2) {
+		std::cerr << "usage: texture_compressor <image> [bc1|bc3] [output]" << std::endl;
+		return 1;
+	}
+
+	try {
+		std::string input = argv[1];
+		Image image(input, false, false);
+		auto [width, height, n_channels] = image.shape();
+
+		TextureFormat format = n_channels == 4 ? TextureFormat::BC3 : TextureFormat::BC1;
+		if(argc >= 3) {
+			std::string name = argv[2];
+			if(name == "bc1") format = TextureFormat::BC1;
+			else if(name == "bc3") format = TextureFormat::BC3;
+			else throw simple_exception(std::format("error: unknown format `{}`.", name));
+		}
+		std::string output = argc >= 4 ? argv[3] : input + ".bct";
+
+		// BC1 不保存 alpha（解码后总是不透明）
+		if(format == TextureFormat::BC1 && n_channels == 4) {
+			const unsigned char* data = image.data();
+			bool opaque = true;
+			for(size_t i = 0; i < (size_t)width * height && opaque; i++) {
+				opaque = data[i * 4 + 3] == 255;
+			}
+			if(!opaque) {
+				std::cerr << std::format("warning: `{}` has an alpha channel, which bc1 drops; use bc3 to keep it.", input) << std::endl;
+			}
+		}
+
+		Texture texture(image, TextureFilter::Trilinear, TextureWrap::Repeat, format);
+		texture.save(output);
+
+		std::cout << std::format("{}: {}x{}, {} levels, {} -> {} bytes",
+			output, texture.width(), texture.height(), texture.n_levels(),
+			(size_t)width * height * 4, texture.memory_size()) << std::endl;
+	} catch(const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "common_header.hpp"
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <exception>
+
+// 固定数量的工作线程。run() 阻塞直到所有任务完成，调用线程本身也参与执行任务。
+class ThreadPool {
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable cv_start;
+    std::condition_variable cv_done;
+
+    const std::function<void(int)>* job = nullptr;
+    int n_tasks = 0;
+    std::atomic<int> next_task = 0;
+    uint64_t generation = 0;
+    int n_running = 0;
+    bool stopping = false;
+    std::exception_ptr error = nullptr;
+
+    void work() {
+        while(true) {
+            int task = next_task.fetch_add(1);
+            if(task >= n_tasks) break;
+            try {
+                (*job)(task);
+            } catch(...) {
+                std::lock_guard lock(mutex);
+                if(!error) error = std::current_exception();
+                next_task = n_tasks; // 剩下的任务不再执行
+            }
+        }
+    }
+
+    void loop() {
+        uint64_t seen = 0;
+        while(true) {
+            {
+                std::unique_lock lock(mutex);
+                cv_start.wait(lock, [&] { return stopping || generation != seen; });
+                if(stopping) return;
+                seen = generation;
+            }
+            work();
+            {
+                std::lock_guard lock(mutex);
+                if(--n_running == 0) cv_done.notify_one();
+            }
+        }
+    }
+
+public:
+    explicit ThreadPool(int n_workers) {
+        for(int i = 1; i < n_workers; i++) {
+            threads.emplace_back(&ThreadPool::loop, this);
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool() {
+        {
+            std::lock_guard lock(mutex);
+            stopping = true;
+        }
+        cv_start.notify_all();
+        for(auto& t: threads) t.join();
+    }
+
+    int size() const { return (int)threads.size() + 1; }
+
+    // fn(task)：task ∈ [0, tasks)。同一线程上的任务串行执行。
+    void run(int tasks, const std::function<void(int)>& fn) {
+        {
+            std::lock_guard lock(mutex);
+            job = &fn;
+            n_tasks = tasks;
+            next_task = 0;
+            n_running = (int)threads.size();
+            error = nullptr;
+            generation++;
+        }
+        cv_start.notify_all();
+        work();
+
+        std::unique_lock lock(mutex);
+        cv_done.wait(lock, [&] { return n_running == 0; });
+        if(error) std::rethrow_exception(error);
+    }
+};
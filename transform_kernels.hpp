@@ -0,0 +1,189 @@
+#pragma once
+
+#include "common_header.hpp"
+#include "matrix.hpp"
+#include "clipping.hpp"
+#include "raster_kernels.hpp"
+#include <cstdint>
+#include <cassert>
+#include <span>
+
+// 顶点位置的批量变换：每 TRANSFORM_BATCH 个点转成 SoA 后一起乘 Mat4（w 视为 1），顺带算裁剪空间的 outcode。
+// 逐个点的累加顺序与 Mat4 * to_vec4_as_pos(p) 相同，outcode 与 ClipVolume::outcode 的算式相同，结果逐位一致。
+
+constexpr int TRANSFORM_BATCH = 8;
+
+struct PointBatch {
+    alignas(32) float x[TRANSFORM_BATCH];
+    alignas(32) float y[TRANSFORM_BATCH];
+    alignas(32) float z[TRANSFORM_BATCH];
+};
+
+// 只写前 count 个 out；volume 不为空时同时写前 count 个 codes
+using TransformKernel = void (*)(const Mat4& m, const PointBatch& in, int count, Vec4* out, const ClipVolume* volume, uint32_t* codes);
+
+inline void transform_batch_scalar(const Mat4& m, const PointBatch& in, int count, Vec4* out, const ClipVolume* volume, uint32_t* codes) {
+    const float* a = m.raw();
+    for(int i = 0; i < count; i++) {
+        for(int r = 0; r < 4; r++) {
+            out[i][r] = a[4 * r] * in.x[i] + a[4 * r + 1] * in.y[i] + a[4 * r + 2] * in.z[i] + a[4 * r + 3];
+        }
+        if(volume) codes[i] = volume->outcode(out[i]);
+    }
+}
+
+#ifdef RASTER_KERNELS_X86
+
+// masks[p] 的第 i 位为 1 表示第 i 个点在平面 p 外侧
+inline void transform_gather_outcodes(const int masks[ClipVolume::N_PLANES], int count, uint32_t* codes) {
+    for(int i = 0; i < count; i++) {
+        uint32_t code = 0;
+        for(int plane = 0; plane < ClipVolume::N_PLANES; plane++) {
+            code |= (uint32_t)((masks[plane] >> i) & 1) << plane;
+        }
+        codes[i] = code;
+    }
+}
+
+inline void transform_batch_sse(const Mat4& m, const PointBatch& in, int count, Vec4* out, const ClipVolume* volume, uint32_t* codes) {
+    const float* a = m.raw();
+    for(int half = 0; half * 4 < count; half++) {
+        __m128 x = _mm_load_ps(in.x + half * 4);
+        __m128 y = _mm_load_ps(in.y + half * 4);
+        __m128 z = _mm_load_ps(in.z + half * 4);
+
+        __m128 rows[4];
+        for(int r = 0; r < 4; r++) {
+            __m128 v = _mm_mul_ps(_mm_set1_ps(a[4 * r]), x);
+            v = _mm_add_ps(v, _mm_mul_ps(_mm_set1_ps(a[4 * r + 1]), y));
+            v = _mm_add_ps(v, _mm_mul_ps(_mm_set1_ps(a[4 * r + 2]), z));
+            rows[r] = _mm_add_ps(v, _mm_set1_ps(a[4 * r + 3]));
+        }
+
+        int n = std::min(4, count - half * 4);
+        if(volume) {
+            const __m128 zero = _mm_setzero_ps();
+            __m128 gw = _mm_mul_ps(_mm_set1_ps(volume->guard_band), rows[3]);
+            __m128 distances[ClipVolume::N_PLANES] = {
+                _mm_sub_ps(rows[3], _mm_set1_ps(volume->near)),
+                _mm_sub_ps(_mm_set1_ps(volume->far), rows[3]),
+                _mm_add_ps(gw, rows[0]),
+                _mm_sub_ps(gw, rows[0]),
+                _mm_add_ps(gw, rows[1]),
+                _mm_sub_ps(gw, rows[1]),
+            };
+            int masks[ClipVolume::N_PLANES];
+            for(int plane = 0; plane < ClipVolume::N_PLANES; plane++) {
+                masks[plane] = _mm_movemask_ps(_mm_cmplt_ps(distances[plane], zero));
+            }
+            transform_gather_outcodes(masks, n, codes + half * 4);
+        }
+
+        // 行 -> 点
+        _MM_TRANSPOSE4_PS(rows[0], rows[1], rows[2], rows[3]);
+        for(int i = 0; i < n; i++) {
+            _mm_store_ps(out[half * 4 + i].raw(), rows[i]);
+        }
+    }
+}
+
+RASTER_TARGET_AVX2
+inline void transform_batch_avx2(const Mat4& m, const PointBatch& in, int count, Vec4* out, const ClipVolume* volume, uint32_t* codes) {
+    const float* a = m.raw();
+    __m256 x = _mm256_load_ps(in.x);
+    __m256 y = _mm256_load_ps(in.y);
+    __m256 z = _mm256_load_ps(in.z);
+
+    __m256 rows[4];
+    for(int r = 0; r < 4; r++) {
+        __m256 v = _mm256_mul_ps(_mm256_set1_ps(a[4 * r]), x);
+        v = _mm256_add_ps(v, _mm256_mul_ps(_mm256_set1_ps(a[4 * r + 1]), y));
+        v = _mm256_add_ps(v, _mm256_mul_ps(_mm256_set1_ps(a[4 * r + 2]), z));
+        rows[r] = _mm256_add_ps(v, _mm256_set1_ps(a[4 * r + 3]));
+    }
+
+    if(volume) {
+        const __m256 zero = _mm256_setzero_ps();
+        __m256 gw = _mm256_mul_ps(_mm256_set1_ps(volume->guard_band), rows[3]);
+        __m256 distances[ClipVolume::N_PLANES] = {
+            _mm256_sub_ps(rows[3], _mm256_set1_ps(volume->near)),
+            _mm256_sub_ps(_mm256_set1_ps(volume->far), rows[3]),
+            _mm256_add_ps(gw, rows[0]),
+            _mm256_sub_ps(gw, rows[0]),
+            _mm256_add_ps(gw, rows[1]),
+            _mm256_sub_ps(gw, rows[1]),
+        };
+        int masks[ClipVolume::N_PLANES];
+        for(int plane = 0; plane < ClipVolume::N_PLANES; plane++) {
+            masks[plane] = _mm256_movemask_ps(_mm256_cmp_ps(distances[plane], zero, _CMP_LT_OQ));
+        }
+        transform_gather_outcodes(masks, count, codes);
+    }
+
+    // 每 128 位一半各自转置：行 -> 点
+    for(int half = 0; half * 4 < count; half++) {
+        __m128 r0, r1, r2, r3;
+        if(half == 0) {
+            r0 = _mm256_castps256_ps128(rows[0]);
+            r1 = _mm256_castps256_ps128(rows[1]);
+            r2 = _mm256_castps256_ps128(rows[2]);
+            r3 = _mm256_castps256_ps128(rows[3]);
+        } else {
+            r0 = _mm256_extractf128_ps(rows[0], 1);
+            r1 = _mm256_extractf128_ps(rows[1], 1);
+            r2 = _mm256_extractf128_ps(rows[2], 1);
+            r3 = _mm256_extractf128_ps(rows[3], 1);
+        }
+        _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+        __m128 points[4] = { r0, r1, r2, r3 };
+        int n = std::min(4, count - half * 4);
+        for(int i = 0; i < n; i++) {
+            _mm_store_ps(out[half * 4 + i].raw(), points[i]);
+        }
+    }
+}
+
+#endif
+
+inline TransformKernel select_transform_kernel() {
+#ifdef RASTER_KERNELS_X86
+    if(cpu_has_avx2()) return transform_batch_avx2;
+    return transform_batch_sse;
+#else
+    return transform_batch_scalar;
+#endif
+}
+
+inline TransformKernel transform_kernel() {
+    static const TransformKernel kernel = select_transform_kernel();
+    return kernel;
+}
+
+// 内部实现，调用者保证 out（以及 volume 不为空时的 codes）不短于 in
+inline void transform_points_impl(const Mat4& m, std::span<const Vec3> in, std::span<Vec4> out, const ClipVolume* volume, std::span<uint32_t> codes) {
+    auto kernel = transform_kernel();
+    PointBatch batch;
+    for(size_t base = 0; base < in.size(); base += TRANSFORM_BATCH) {
+        int count = (int)std::min<size_t>(TRANSFORM_BATCH, in.size() - base);
+        for(int i = 0; i < TRANSFORM_BATCH; i++) {
+            const float* p = i < count ? in[base + i].raw() : nullptr;
+            batch.x[i] = p ? p[0] : 0;
+            batch.y[i] = p ? p[1] : 0;
+            batch.z[i] = p ? p[2] : 0;
+        }
+        kernel(m, batch, count, out.data() + base, volume, volume ? codes.data() + base : nullptr);
+    }
+}
+
+// out[i] = m * (in[i], 1)
+inline void transform_points(const Mat4& m, std::span<const Vec3> in, std::span<Vec4> out) {
+    assert(out.size() >= in.size());
+    transform_points_impl(m, in, out, nullptr, {});
+}
+
+// 同上，另外 codes[i] = volume.outcode(out[i])
+inline void transform_points(const Mat4& m, std::span<const Vec3> in, std::span<Vec4> out, const ClipVolume& volume, std::span<uint32_t> codes) {
+    assert(out.size() >= in.size());
+    assert(codes.size() >= in.size());
+    transform_points_impl(m, in, out, &volume, codes);
+}
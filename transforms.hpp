@@ -5,7 +5,7 @@
 #include "matrix.hpp"
 
 // dir: [inWorld(objX) inWorld(objY) inWorld(objZ)]
-Mat4 model_transform(Vec3 pos, Mat3 dir) {
+constexpr Mat4 model_transform(Vec3 pos, Mat3 dir) {
     Mat4 mat;
     for(int i = 0; i < 3; i++) 
         for(int j = 0; j < 3; j++) 
@@ -20,7 +20,7 @@ Mat4 model_transform(Vec3 pos, Mat3 dir) {
     return mat;
 }
 
-Mat4 view_transform(Vec3 camera_pos, Vec3 camera_dir, Vec3 camera_top) {
+constexpr Mat4 view_transform(Vec3 camera_pos, Vec3 camera_dir, Vec3 camera_top) {
     camera_dir.normalize();
     camera_top.normalize();
     
@@ -48,7 +48,7 @@ Mat4 view_transform(Vec3 camera_pos, Vec3 camera_dir, Vec3 camera_top) {
     return mat1 * mat2;
 }
 
-Mat4 projection_transform(float near, float far) {
+constexpr Mat4 projection_transform(float near, float far) {
     Mat4 mat;
     mat[{0, 0}] = near;
     mat[{1, 1}] = near;
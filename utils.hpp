@@ -11,5 +11,5 @@ std::string trimmed(const std::string& str);
 struct simple_exception : public std::exception {
     std::string m_what;
     simple_exception(const std::string& what) : m_what(what) {}
-    virtual const char* what() const { return m_what.c_str(); }
+    virtual const char* what() const noexcept override { return m_what.c_str(); }
 };